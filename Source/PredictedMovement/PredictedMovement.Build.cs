@@ -20,7 +20,11 @@ public class PredictedMovement : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"NetCore",
 			}
 			);
+
+		// Iris replicates the packed move data and push-based properties without custom serializers
+		SetupIrisSupport(Target);
 	}
 }
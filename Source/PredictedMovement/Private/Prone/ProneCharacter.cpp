@@ -3,24 +3,178 @@
 
 #include "Prone/ProneCharacter.h"
 
+#include "HAL/IConsoleManager.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "Prone/ProneMovement.h"
+#include "System/PredictedMovementCosmetics.h"
+#include "System/PredictedMovementSubsystem.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(ProneCharacter)
 
+namespace ProneCharacterCVars
+{
+	static int32 ProxyCosmeticsPerFrame = 8;
+	FAutoConsoleVariableRef CVarProxyCosmeticsPerFrame(
+		TEXT("p.Prone.ProxyCosmeticsPerFrame"),
+		ProxyCosmeticsPerFrame,
+		TEXT("Deferred prone cosmetics applied per frame for simulated proxies that are not significant. 0 applies them immediately."),
+		ECVF_Default);
+}
+
 AProneCharacter::AProneCharacter(const FObjectInitializer& FObjectInitializer)
 	: Super(FObjectInitializer.SetDefaultSubobjectClass<UProneMovement>(CharacterMovementComponentName))
 {
 	ProneMovement = Cast<UProneMovement>(GetCharacterMovement());
 
 	PronedEyeHeight = 30.f;
+
+	ReplicatedStanceState = EProneStanceState::None;
+
+	PendingProxyCosmetics = EProneProxyCosmetics::None;
+	PendingHalfHeightAdjust = 0.f;
+	PendingScaledHalfHeightAdjust = 0.f;
+	bPendingIsCrouched = false;
+	PendingMeshTranslationOffset = 0.f;
+	bApplyingPendingProxyCosmetics = false;
 }
 
 void AProneCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME_CONDITION(ThisClass, bIsProned, COND_SimulatedOnly);
+	FDoRepLifetimeParams SharedParams;
+	SharedParams.bIsPushBased = true;
+	SharedParams.Condition = COND_SimulatedOnly;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(ThisClass, ReplicatedStanceState, SharedParams);
+
+	// Replicated through ReplicatedStanceState instead
+	DISABLE_REPLICATED_PROPERTY(ACharacter, bIsCrouched);
+}
+
+void AProneCharacter::UpdatePendingProxyCosmetics()
+{
+	if (PendingProxyCosmetics != EProneProxyCosmetics::None)
+	{
+		// Significant again, don't wait for the budget
+		if (!ShouldDeferProxyCosmetics() || ConsumeProxyCosmeticsBudget())
+		{
+			ApplyPendingProxyCosmetics();
+		}
+	}
+}
+
+bool AProneCharacter::ShouldDeferProxyCosmetics() const
+{
+	return ProneCharacterCVars::ProxyCosmeticsPerFrame > 0 && GetLocalRole() == ROLE_SimulatedProxy && !WasRecentlyRendered(0.2f);
+}
+
+bool AProneCharacter::ConsumeProxyCosmeticsBudget() const
+{
+	// The budget is shared by the proxies of each world
+	UPredictedMovementSubsystem* Subsystem = UWorld::GetSubsystem<UPredictedMovementSubsystem>(GetWorld());
+	return !Subsystem || Subsystem->ConsumeProxyCosmeticsBudget(ProneCharacterCVars::ProxyCosmeticsPerFrame);
+}
+
+bool AProneCharacter::DeferProxyCosmetics(EProneProxyCosmetics Transition, float HalfHeightAdjust, float ScaledHalfHeightAdjust)
+{
+	if (bApplyingPendingProxyCosmetics)
+	{
+		return false;
+	}
+
+	// The opposite transition is still waiting, the cosmetics already match the new state
+	if (PendingProxyCosmetics != EProneProxyCosmetics::None && PendingProxyCosmetics != Transition)
+	{
+		PendingProxyCosmetics = EProneProxyCosmetics::None;
+		return true;
+	}
+
+	// The same transition again replaces the pending one
+	PendingProxyCosmetics = EProneProxyCosmetics::None;
+	if (!ShouldDeferProxyCosmetics())
+	{
+		return false;
+	}
+
+	PendingProxyCosmetics = Transition;
+	PendingHalfHeightAdjust = HalfHeightAdjust;
+	PendingScaledHalfHeightAdjust = ScaledHalfHeightAdjust;
+	bPendingIsCrouched = bIsCrouched;
+	return true;
+}
+
+void AProneCharacter::ApplyPendingProxyCosmetics()
+{
+	const EProneProxyCosmetics Transition = PendingProxyCosmetics;
+	PendingProxyCosmetics = EProneProxyCosmetics::None;
+
+	TGuardValue<bool> ApplyingGuard(bApplyingPendingProxyCosmetics, true);
+	switch (Transition)
+	{
+	case EProneProxyCosmetics::StartProne:
+		OnStartProne(PendingHalfHeightAdjust, PendingScaledHalfHeightAdjust);
+		break;
+	case EProneProxyCosmetics::EndProne:
+		{
+			// Apply as of the deferred transition, the crouch cosmetics since then were applied after it
+			const bool bWasCrouched = bIsCrouched;
+			bIsCrouched = bPendingIsCrouched;
+			OnEndProne(PendingHalfHeightAdjust, PendingScaledHalfHeightAdjust);
+			bIsCrouched = bWasCrouched;
+		}
+		break;
+	default:
+		break;
+	}
+
+	ApplyPendingMeshTranslationOffset();
+}
+
+void AProneCharacter::AddProxyMeshTranslationOffset(float DeltaZ)
+{
+	// A cancelled opposite transition leaves its offset here, and the two cancel out as well
+	PendingMeshTranslationOffset += DeltaZ;
+	if (PendingProxyCosmetics == EProneProxyCosmetics::None)
+	{
+		ApplyPendingMeshTranslationOffset();
+	}
+}
+
+void AProneCharacter::ApplyPendingMeshTranslationOffset()
+{
+	if (PendingMeshTranslationOffset == 0.f)
+	{
+		return;
+	}
+
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	if (FNetworkPredictionData_Client_Character* ClientData = Movement ? Movement->GetPredictionData_Client_Character() : nullptr)
+	{
+		ClientData->MeshTranslationOffset.Z += PendingMeshTranslationOffset;
+		ClientData->OriginalMeshTranslationOffset = ClientData->MeshTranslationOffset;
+	}
+	PendingMeshTranslationOffset = 0.f;
+}
+
+void AProneCharacter::OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust)
+{
+	// Crouch cosmetics are not deferred, apply a pending prone transition first to keep them in order
+	if (PendingProxyCosmetics != EProneProxyCosmetics::None)
+	{
+		ApplyPendingProxyCosmetics();
+	}
+	Super::OnStartCrouch(HalfHeightAdjust, ScaledHalfHeightAdjust);
+}
+
+void AProneCharacter::OnEndCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust)
+{
+	if (PendingProxyCosmetics != EProneProxyCosmetics::None)
+	{
+		ApplyPendingProxyCosmetics();
+	}
+	Super::OnEndCrouch(HalfHeightAdjust, ScaledHalfHeightAdjust);
 }
 
 void AProneCharacter::RecalculateBaseEyeHeight()
@@ -35,22 +189,70 @@ void AProneCharacter::RecalculateBaseEyeHeight()
 	}
 }
 
-void AProneCharacter::OnRep_IsProned()
+uint8 AProneCharacter::GetStanceState() const
 {
-	if (ProneMovement)
+	uint8 StanceState = EProneStanceState::None;
+	if (bIsCrouched)
 	{
-		if (bIsProned)
-		{
-			ProneMovement->bWantsToProne = true;
-			ProneMovement->Prone(true);
-		}
-		else
+		StanceState |= EProneStanceState::Crouched;
+	}
+	if (bIsProned)
+	{
+		StanceState |= EProneStanceState::Proned;
+	}
+	return StanceState;
+}
+
+void AProneCharacter::MarkStanceStateDirty()
+{
+	if (!HasAuthority())
+	{
+		return;
+	}
+
+	const uint8 StanceState = GetStanceState();
+	if (ReplicatedStanceState != StanceState)
+	{
+		ReplicatedStanceState = StanceState;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ThisClass, ReplicatedStanceState, this);
+	}
+}
+
+void AProneCharacter::OnRep_StanceState(uint8 PreviousStanceState)
+{
+	bIsCrouched = (ReplicatedStanceState & EProneStanceState::Crouched) != 0;
+	bIsProned = (ReplicatedStanceState & EProneStanceState::Proned) != 0;
+
+	const uint8 ChangedStanceState = ReplicatedStanceState ^ PreviousStanceState;
+	if (ProneMovement && ChangedStanceState != EProneStanceState::None)
+	{
+		// Exits first, from the smallest capsule up
+		if ((ChangedStanceState & EProneStanceState::Proned) && !bIsProned)
 		{
 			ProneMovement->bWantsToProne = false;
 			ProneMovement->UnProne(true);
 		}
+		if ((ChangedStanceState & EProneStanceState::Crouched) && !bIsCrouched)
+		{
+			ProneMovement->bWantsToCrouch = false;
+			ProneMovement->UnCrouch(true);
+		}
+
+		// Then entries
+		if ((ChangedStanceState & EProneStanceState::Crouched) && bIsCrouched)
+		{
+			ProneMovement->bWantsToCrouch = true;
+			ProneMovement->Crouch(true);
+		}
+		if ((ChangedStanceState & EProneStanceState::Proned) && bIsProned)
+		{
+			ProneMovement->bWantsToProne = true;
+			ProneMovement->Prone(true);
+		}
 		ProneMovement->bNetworkUpdateReceived = true;
 	}
+
+	OnStanceStateReplicated(PreviousStanceState, ChangedStanceState);
 }
 
 void AProneCharacter::Prone(bool bClientSimulation)
@@ -79,8 +281,19 @@ bool AProneCharacter::CanProne() const
 
 void AProneCharacter::OnEndProne(float HeightAdjust, float ScaledHeightAdjust)
 {
+	if (DeferProxyCosmetics(EProneProxyCosmetics::EndProne, HeightAdjust, ScaledHeightAdjust))
+	{
+		return;
+	}
+
+	// Eye height is used by gameplay on the server, keep it
 	RecalculateBaseEyeHeight();
 
+	if (PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		return;
+	}
+
 	if (!bIsCrouched)
 	{
 		const ACharacter* DefaultChar = GetDefault<ACharacter>(GetClass());
@@ -100,8 +313,19 @@ void AProneCharacter::OnEndProne(float HeightAdjust, float ScaledHeightAdjust)
 
 void AProneCharacter::OnStartProne(float HeightAdjust, float ScaledHeightAdjust)
 {
+	if (DeferProxyCosmetics(EProneProxyCosmetics::StartProne, HeightAdjust, ScaledHeightAdjust))
+	{
+		return;
+	}
+
+	// Eye height is used by gameplay on the server, keep it
 	RecalculateBaseEyeHeight();
 
+	if (PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		return;
+	}
+
 	const ACharacter* DefaultChar = GetDefault<ACharacter>(GetClass());
 	if (GetMesh() && DefaultChar->GetMesh())
 	{
@@ -0,0 +1,257 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "Prone/ProneClearanceField.h"
+
+#include "Components/BoxComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "Prone/ProneCharacter.h"
+#include "Prone/ProneClearanceSubsystem.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(ProneClearanceField)
+
+AProneClearanceField::AProneClearanceField(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Bounds = CreateDefaultSubobject<UBoxComponent>(TEXT("Bounds"));
+	Bounds->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Bounds->SetBoxExtent(FVector(1000.f, 1000.f, 500.f));
+	Bounds->SetCanEverAffectNavigation(false);
+	RootComponent = Bounds;
+
+	PrimaryActorTick.bCanEverTick = false;
+	SetCanBeDamaged(false);
+
+	CharacterClass = AProneCharacter::StaticClass();
+	CellSize = 20.f;
+	HeightTolerance = 5.f;
+	bBakeOnBeginPlay = false;
+
+	GridOrigin = FVector::ZeroVector;
+	GridSize = FIntPoint::ZeroValue;
+	BakedRadius = 0.f;
+	BakedStandHalfHeight = 0.f;
+	BakedCrouchHalfHeight = 0.f;
+}
+
+void AProneClearanceField::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (bBakeOnBeginPlay)
+	{
+		Bake();
+	}
+
+	if (UProneClearanceSubsystem* ClearanceSubsystem = UWorld::GetSubsystem<UProneClearanceSubsystem>(GetWorld()))
+	{
+		ClearanceSubsystem->RegisterField(this);
+	}
+}
+
+void AProneClearanceField::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UProneClearanceSubsystem* ClearanceSubsystem = UWorld::GetSubsystem<UProneClearanceSubsystem>(GetWorld()))
+	{
+		ClearanceSubsystem->UnregisterField(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AProneClearanceField::Bake()
+{
+	const UWorld* World = GetWorld();
+	const AProneCharacter* DefaultCharacter = CharacterClass ? CharacterClass->GetDefaultObject<AProneCharacter>() : nullptr;
+	const UCapsuleComponent* DefaultCapsule = DefaultCharacter ? DefaultCharacter->GetCapsuleComponent() : nullptr;
+	const UProneMovement* DefaultMovement = DefaultCharacter ? Cast<UProneMovement>(DefaultCharacter->GetCharacterMovement()) : nullptr;
+	if (!World || !DefaultCapsule || !DefaultMovement)
+	{
+		return;
+	}
+
+	Modify();
+
+	const FBox Box = Bounds->Bounds.GetBox();
+	GridOrigin = Box.Min;
+	GridSize.X = FMath::Max(1, FMath::CeilToInt32((Box.Max.X - Box.Min.X) / CellSize));
+	GridSize.Y = FMath::Max(1, FMath::CeilToInt32((Box.Max.Y - Box.Min.Y) / CellSize));
+	Cells.Init(EProneClearanceCell::None, GridSize.X * GridSize.Y);
+	FloorHeights.Init(0, GridSize.X * GridSize.Y);
+
+	// Scaled stance capsules, matching UProneMovement::GetStanceCapsule()
+	const float Scale = DefaultCapsule->GetShapeScale();
+	const float StandRadius = DefaultCapsule->GetUnscaledCapsuleRadius() * Scale;
+	const float StandHalfHeight = DefaultCapsule->GetUnscaledCapsuleHalfHeight() * Scale;
+	const float CrouchHalfHeight = DefaultMovement->GetCrouchedHalfHeight() * Scale;
+	const float ProneRadius = DefaultMovement->PronedRadius * Scale;
+	const float ProneHalfHeight = FMath::Max3(0.f, DefaultMovement->PronedRadius, DefaultMovement->PronedHalfHeight) * Scale;
+	BakedRadius = StandRadius;
+	BakedStandHalfHeight = StandHalfHeight;
+	BakedCrouchHalfHeight = CrouchHalfHeight;
+
+	// Placing the stance capsule anywhere in the cell moves its axis by up to half the cell diagonal horizontally, and
+	// by up to the height tolerance (plus the rounding of the stored floor height) vertically
+	const float HalfDiagonal = CellSize * UE_HALF_SQRT_2;
+	const float VerticalSlack = HeightTolerance + 0.5f;
+
+	// Only static geometry is baked, characters and other movable actors would invalidate the data immediately
+	const ECollisionChannel CollisionChannel = DefaultCapsule->GetCollisionObjectType();
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ProneClearanceFieldBake), false, this);
+	QueryParams.MobilityType = EQueryMobilityType::Static;
+	const FCollisionResponseParams ResponseParams(DefaultCapsule->GetCollisionResponseToChannels());
+	const float WalkableFloorZ = DefaultMovement->GetWalkableFloorZ();
+
+	auto Fits = [&](const FVector& Base, float Radius, float HalfHeight)
+	{
+		if (Radius <= 0.f || HalfHeight <= 0.f)
+		{
+			return false;
+		}
+		const FVector Center = Base + FVector(0.f, 0.f, HalfHeight + UCharacterMovementComponent::MIN_FLOOR_DIST);
+		return !World->OverlapBlockingTestByChannel(Center, FQuat::Identity, CollisionChannel,
+			FCollisionShape::MakeCapsule(Radius, HalfHeight), QueryParams, ResponseParams);
+	};
+
+	// Test the intersection of every placement of the stance capsule within the cell. It contains a capsule with the
+	// same center whose segment is shortened by the vertical slack and whose radius is reduced by the horizontal slack
+	// (and by any vertical slack the segment could not absorb), so if that capsule is blocked every placement is blocked
+	auto IsBlockedThroughoutCell = [&](const FVector& Base, float Radius, float HalfHeight)
+	{
+		const float SegmentHalfLength = HalfHeight - Radius;
+		const float InnerRadius = Radius - HalfDiagonal - FMath::Max(0.f, VerticalSlack - SegmentHalfLength);
+		const float InnerHalfHeight = HalfHeight - HalfDiagonal - VerticalSlack;
+		if (InnerRadius <= 0.f || InnerHalfHeight < InnerRadius)
+		{
+			return false;
+		}
+		const FVector Center = Base + FVector(0.f, 0.f, HalfHeight + UCharacterMovementComponent::MIN_FLOOR_DIST);
+		return World->OverlapBlockingTestByChannel(Center, FQuat::Identity, CollisionChannel,
+			FCollisionShape::MakeCapsule(InnerRadius, InnerHalfHeight), QueryParams, ResponseParams);
+	};
+
+	for (int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for (int32 X = 0; X < GridSize.X; ++X)
+		{
+			const int32 Index = Y * GridSize.X + X;
+			const FVector2D CellCenter = FVector2D(GridOrigin) + (FVector2D(X, Y) + 0.5f) * CellSize;
+
+			FHitResult Hit;
+			if (!World->LineTraceSingleByChannel(Hit, FVector(CellCenter, Box.Max.Z), FVector(CellCenter, Box.Min.Z),
+				CollisionChannel, QueryParams, ResponseParams) || Hit.bStartPenetrating || Hit.ImpactNormal.Z < WalkableFloorZ)
+			{
+				continue;
+			}
+
+			const FVector Base = Hit.ImpactPoint;
+			uint8 Flags = EProneClearanceCell::HasFloor;
+			if (Fits(Base, StandRadius, StandHalfHeight))
+			{
+				Flags |= EProneClearanceCell::StandFits;
+			}
+			else if (IsBlockedThroughoutCell(Base, StandRadius, StandHalfHeight))
+			{
+				Flags |= EProneClearanceCell::StandBlockedInCell;
+			}
+
+			if (Fits(Base, StandRadius, CrouchHalfHeight))
+			{
+				Flags |= EProneClearanceCell::CrouchFits;
+			}
+			else if (IsBlockedThroughoutCell(Base, StandRadius, CrouchHalfHeight))
+			{
+				Flags |= EProneClearanceCell::CrouchBlockedInCell;
+			}
+
+			if (Fits(Base, ProneRadius, ProneHalfHeight))
+			{
+				Flags |= EProneClearanceCell::ProneFits;
+			}
+
+			Cells[Index] = Flags;
+			FloorHeights[Index] = static_cast<int16>(FMath::Clamp(FMath::RoundToInt32(Base.Z - GridOrigin.Z), MIN_int16, MAX_int16));
+		}
+	}
+}
+
+bool AProneClearanceField::GetCellFlags(const FVector& BaseLocation, uint8& OutFlags) const
+{
+	const int32 X = FMath::FloorToInt32((BaseLocation.X - GridOrigin.X) / CellSize);
+	const int32 Y = FMath::FloorToInt32((BaseLocation.Y - GridOrigin.Y) / CellSize);
+	if (X < 0 || Y < 0 || X >= GridSize.X || Y >= GridSize.Y)
+	{
+		return false;
+	}
+
+	const int32 Index = Y * GridSize.X + X;
+	if (!Cells.IsValidIndex(Index) || !(Cells[Index] & EProneClearanceCell::HasFloor))
+	{
+		return false;
+	}
+
+	// Only the topmost floor is baked, and blocked flags only hold for a base close to the baked floor height
+	const float BakedBaseZ = GridOrigin.Z + FloorHeights[Index] + UCharacterMovementComponent::MIN_FLOOR_DIST;
+	if (FMath::Abs(BaseLocation.Z - BakedBaseZ) > HeightTolerance)
+	{
+		return false;
+	}
+
+	OutFlags = Cells[Index];
+	return true;
+}
+
+bool AProneClearanceField::GetTallestStanceAtLocation(const FVector& Location, EProneStance& OutStance) const
+{
+	uint8 Flags;
+	if (!GetCellFlags(Location, Flags))
+	{
+		return false;
+	}
+
+	if (Flags & EProneClearanceCell::StandFits)
+	{
+		OutStance = EProneStance::Stand;
+	}
+	else if (Flags & EProneClearanceCell::CrouchFits)
+	{
+		OutStance = EProneStance::Crouch;
+	}
+	else if (Flags & EProneClearanceCell::ProneFits)
+	{
+		OutStance = EProneStance::Prone;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool AProneClearanceField::IsStanceBlocked(const FVector& BaseLocation, EProneStance TargetStance,
+	const FProneStanceCapsule& ScaledCapsule) const
+{
+	// The blocked flags only hold for the capsule they were baked with
+	const float BakedHalfHeight = TargetStance == EProneStance::Crouch ? BakedCrouchHalfHeight : BakedStandHalfHeight;
+	if (!FMath::IsNearlyEqual(ScaledCapsule.Radius, BakedRadius) || !FMath::IsNearlyEqual(ScaledCapsule.HalfHeight, BakedHalfHeight))
+	{
+		return false;
+	}
+
+	uint8 Flags;
+	if (!GetCellFlags(BaseLocation, Flags))
+	{
+		return false;
+	}
+
+	switch (TargetStance)
+	{
+	case EProneStance::Stand:
+		return (Flags & EProneClearanceCell::StandBlockedInCell) != 0;
+	case EProneStance::Crouch:
+		return (Flags & EProneClearanceCell::CrouchBlockedInCell) != 0;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,144 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "Prone/ProneClearanceSubsystem.h"
+
+#include "Engine/World.h"
+#include "Prone/ProneClearanceField.h"
+#include "Prone/ProneMovement.h"
+#include "System/PredictedMovementStats.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(ProneClearanceSubsystem)
+
+DECLARE_CYCLE_STAT(TEXT("Prone Clearance Batch"), STAT_PredictedMovement_ProneClearanceBatch, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prone Clearance Async Queries"), STAT_PredictedMovement_ProneClearanceQueries, STATGROUP_PredictedMovement);
+
+namespace ProneClearance
+{
+	/** Queries that still have no result after this many frames are discarded */
+	static constexpr uint64 MaxInFlightFrames = 4;
+}
+
+void UProneClearanceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	OverlapDelegate.BindUObject(this, &ThisClass::OnOverlapCompleted);
+}
+
+void UProneClearanceSubsystem::Deinitialize()
+{
+	OverlapDelegate.Unbind();
+	PendingRequests.Reset();
+	InFlight.Reset();
+	Fields.Reset();
+
+	Super::Deinitialize();
+}
+
+TStatId UProneClearanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProneClearanceSubsystem, STATGROUP_Tickables);
+}
+
+bool UProneClearanceSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UProneClearanceSubsystem::RequestClearance(UProneMovement* Movement, EProneClearanceQuery Query)
+{
+	if (IsValid(Movement))
+	{
+		PendingRequests.AddUnique({ Movement, Query });
+	}
+}
+
+void UProneClearanceSubsystem::RegisterField(AProneClearanceField* Field)
+{
+	if (IsValid(Field))
+	{
+		Fields.AddUnique(Field);
+	}
+}
+
+void UProneClearanceSubsystem::UnregisterField(AProneClearanceField* Field)
+{
+	Fields.Remove(Field);
+}
+
+bool UProneClearanceSubsystem::IsStanceBlockedByField(const FVector& BaseLocation, EProneStance TargetStance,
+	const FProneStanceCapsule& ScaledCapsule) const
+{
+	for (const TWeakObjectPtr<AProneClearanceField>& Field : Fields)
+	{
+		if (Field.IsValid() && Field->IsStanceBlocked(BaseLocation, TargetStance, ScaledCapsule))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void UProneClearanceSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PredictedMovement_ProneClearanceBatch);
+
+	Super::Tick(DeltaTime);
+
+	// Drop queries that never completed
+	for (auto It = InFlight.CreateIterator(); It; ++It)
+	{
+		if (GFrameCounter - It.Value().FrameStamp > ProneClearance::MaxInFlightFrames)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	UWorld* World = GetWorld();
+	for (const FProneClearanceRequest& Request : PendingRequests)
+	{
+		UProneMovement* Movement = Request.Movement.Get();
+		if (!Movement)
+		{
+			continue;
+		}
+
+		FVector Location;
+		FCollisionShape Shape;
+		FCollisionQueryParams CapsuleParams;
+		FCollisionResponseParams ResponseParam;
+		if (!Movement->GetClearanceQuery(Request.Query, Location, Shape, CapsuleParams, ResponseParam))
+		{
+			continue;
+		}
+
+		INC_DWORD_STAT(STAT_PredictedMovement_ProneClearanceQueries);
+		const uint32 RequestId = NextRequestId++;
+		World->AsyncOverlapByChannel(Location, FQuat::Identity, Movement->UpdatedComponent->GetCollisionObjectType(),
+			Shape, CapsuleParams, ResponseParam, &OverlapDelegate, RequestId);
+
+		InFlight.Add(RequestId, { Request, Location, Shape, GFrameCounter });
+	}
+	PendingRequests.Reset();
+}
+
+void UProneClearanceSubsystem::OnOverlapCompleted(const FTraceHandle& TraceHandle, FOverlapDatum& OverlapDatum)
+{
+	FProneClearanceInFlight Completed;
+	if (!InFlight.RemoveAndCopyValue(OverlapDatum.UserData, Completed))
+	{
+		return;
+	}
+
+	if (UProneMovement* Movement = Completed.Request.Movement.Get())
+	{
+		const bool bIsClear = !OverlapDatum.OutOverlaps.ContainsByPredicate([](const FOverlapResult& Overlap)
+		{
+			return Overlap.bBlockingHit;
+		});
+
+		Movement->SetCachedClearance(Completed.Request.Query, Completed.Location, Completed.Shape,
+			Completed.FrameStamp, bIsClear);
+	}
+}
@@ -5,9 +5,30 @@
 
 #include "Components/CapsuleComponent.h"
 #include "Prone/ProneCharacter.h"
+#include "Prone/ProneClearanceSubsystem.h"
+#include "System/PredictedMovementCorrections.h"
+#include "System/PredictedMovementKernel.h"
+#include "System/PredictedMovementStats.h"
+#include "System/PredictedMovementTrace.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(ProneMovement)
 
+DECLARE_CYCLE_STAT(TEXT("Prone"), STAT_PredictedMovement_Prone, STATGROUP_PredictedMovement);
+DECLARE_CYCLE_STAT(TEXT("UnProne"), STAT_PredictedMovement_UnProne, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prone Physics Queries"), STAT_PredictedMovement_ProneQueries, STATGROUP_PredictedMovement);
+
+namespace ProneMovement
+{
+	/** Run a physics query made while changing stance, counted in stat PredictedMovement and traced on its channel */
+	template<typename QueryType>
+	static bool ProneQuery(QueryType&& Query)
+	{
+		PREDICTED_MOVEMENT_TRACE_SCOPE(ProneMovement::PhysicsQuery);
+		INC_DWORD_STAT(STAT_PredictedMovement_ProneQueries);
+		return Query();
+	}
+}
+
 UProneMovement::UProneMovement(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
@@ -22,6 +43,11 @@ UProneMovement::UProneMovement(const FObjectInitializer& ObjectInitializer)
 
 	ProneLockDuration = 1.f;
 
+	UnProneBlockedRetryDelay = 0.1f;
+	UnProneBlockedMaxRetryDelay = 1.f;
+	ReplayedMoveTimestamp = -1.f;
+	bUseProneClearanceField = true;
+
 	bCanWalkOffLedgesWhenProned = false;
 	bWantsToProne = false;
 	bProneLocked = false;
@@ -37,6 +63,7 @@ void UProneMovement::PostLoad()
 	Super::PostLoad();
 
 	ProneCharacterOwner = Cast<AProneCharacter>(PawnOwner);
+	CacheDefaultCapsule();
 }
 
 void UProneMovement::SetUpdatedComponent(USceneComponent* NewUpdatedComponent)
@@ -44,6 +71,82 @@ void UProneMovement::SetUpdatedComponent(USceneComponent* NewUpdatedComponent)
 	Super::SetUpdatedComponent(NewUpdatedComponent);
 
 	ProneCharacterOwner = Cast<AProneCharacter>(PawnOwner);
+	CacheDefaultCapsule();
+}
+
+void UProneMovement::BeginPlay()
+{
+	Super::BeginPlay();
+
+	StateRegistration.Register(this);
+}
+
+void UProneMovement::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StateRegistration.Unregister();
+	Journal.Flush();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UProneMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (HasValidData())
+	{
+		ProneCharacterOwner->UpdatePendingProxyCosmetics();
+
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		StateSnapshot.Publish(Snapshot);
+	}
+}
+
+void UProneMovement::PerformMovement(float DeltaTime)
+{
+	Super::PerformMovement(DeltaTime);
+
+	if (FPredictedMovementJournal::IsEnabled() && HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		Journal.Record(this, Snapshot);
+	}
+}
+
+void UProneMovement::FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const
+{
+	Snapshot.bIsCrouched = IsCrouching();
+	Snapshot.bIsProned = IsProned();
+	Snapshot.bIsProneLocked = IsProneLocked();
+	Snapshot.ProneLockTimestamp = ProneLockTimestamp;
+}
+
+void UProneMovement::CacheDefaultCapsule()
+{
+	if (CharacterOwner)
+	{
+		const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
+		DefaultCapsule.Radius = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius();
+		DefaultCapsule.HalfHeight = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+	}
+}
+
+FProneStanceCapsule UProneMovement::GetStanceCapsule(EProneStance Stance) const
+{
+	switch (Stance)
+	{
+	case EProneStance::Crouch:
+		// Crouching only changes the height
+		return { DefaultCapsule.Radius, GetCrouchedHalfHeight() };
+	case EProneStance::Prone:
+		// Height is not allowed to be smaller than radius.
+		return { PronedRadius, FMath::Max3(0.f, PronedRadius, PronedHalfHeight) };
+	default:
+		return DefaultCapsule;
+	}
 }
 
 float UProneMovement::GetMaxAcceleration() const
@@ -123,9 +226,7 @@ bool UProneMovement::IsProneLockOnTimer() const
 
 float UProneMovement::GetRemainingProneLockCooldown() const
 {
-	const float CurrentTimestamp = GetTimestamp();
-	const float RemainingCooldown = ProneLockDuration - (CurrentTimestamp - ProneLockTimestamp);
-	return FMath::Clamp(RemainingCooldown, 0.f, ProneLockDuration);
+	return PredictedMovementKernel::GetRemainingLockCooldown(ProneLockDuration, GetTimestamp(), ProneLockTimestamp);
 }
 
 void UProneMovement::SetProneLock(bool bLock)
@@ -145,9 +246,9 @@ float UProneMovement::GetTimestamp() const
 {
 	if (CharacterOwner->GetLocalRole() == ROLE_Authority)
 	{
-		if (CharacterOwner->IsLocallyControlled())
+		if (CharacterOwner->GetRemoteRole() != ROLE_AutonomousProxy)
 		{
-			// Server owned character
+			// Server owned character, including NPCs with or without a controller, never needs prediction data
 			return GetWorld()->GetTimeSeconds();
 		}
 		else
@@ -159,12 +260,191 @@ float UProneMovement::GetTimestamp() const
 	}
 	else
 	{
-		// Client owned character
+		// Client owned character, CurrentTimeStamp is the newest move while older ones are replayed
+		if (bClientUpdating && ReplayedMoveTimestamp >= 0.f)
+		{
+			return ReplayedMoveTimestamp;
+		}
 		const FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
 		return ClientData->CurrentTimeStamp;
 	}
 }
 
+bool UProneMovement::DoesUnProneBlockedCacheMatch(EProneStance TargetStance) const
+{
+	if (TargetStance == EProneStance::Prone)
+	{
+		return false;
+	}
+
+	const FProneUnProneBlockedCache& Cache = UnProneBlockedCache[static_cast<uint8>(TargetStance)];
+	if (!Cache.bValid)
+	{
+		return false;
+	}
+
+	const UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
+	if (Capsule->GetUnscaledCapsuleRadius() != Cache.Radius || Capsule->GetUnscaledCapsuleHalfHeight() != Cache.HalfHeight)
+	{
+		return false;
+	}
+
+	if (CurrentFloor.HitResult.GetComponent() != Cache.FloorComponent.Get())
+	{
+		return false;
+	}
+
+	// Exact, so that neither side skips a test because of a difference the other side doesn't have
+	return UpdatedComponent->GetComponentLocation() == Cache.Location;
+}
+
+bool UProneMovement::IsUnProneBlockedCached(EProneStance TargetStance) const
+{
+	if (UnProneBlockedRetryDelay <= 0.f || !DoesUnProneBlockedCacheMatch(TargetStance))
+	{
+		return false;
+	}
+
+	// Client timestamps are periodically reset, which shows up as negative elapsed time
+	const FProneUnProneBlockedCache& Cache = UnProneBlockedCache[static_cast<uint8>(TargetStance)];
+	const float Elapsed = GetTimestamp() - Cache.Timestamp;
+	return Elapsed >= 0.f && Elapsed < Cache.RetryDelay;
+}
+
+void UProneMovement::CacheUnProneBlocked(EProneStance TargetStance)
+{
+	if (UnProneBlockedRetryDelay <= 0.f || TargetStance == EProneStance::Prone)
+	{
+		return;
+	}
+
+	// Still blocked under the same conditions after the previous delay elapsed, back off further
+	FProneUnProneBlockedCache& Cache = UnProneBlockedCache[static_cast<uint8>(TargetStance)];
+	const bool bBackOff = DoesUnProneBlockedCacheMatch(TargetStance);
+	Cache.RetryDelay = bBackOff ? FMath::Min(Cache.RetryDelay * 2.f, UnProneBlockedMaxRetryDelay) : UnProneBlockedRetryDelay;
+
+	const UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
+	Cache.Location = UpdatedComponent->GetComponentLocation();
+	Cache.FloorComponent = CurrentFloor.HitResult.GetComponent();
+	Cache.Radius = Capsule->GetUnscaledCapsuleRadius();
+	Cache.HalfHeight = Capsule->GetUnscaledCapsuleHalfHeight();
+	Cache.Timestamp = GetTimestamp();
+	Cache.bValid = true;
+}
+
+void UProneMovement::InvalidateUnProneBlockedCache()
+{
+	for (FProneUnProneBlockedCache& Cache : UnProneBlockedCache)
+	{
+		Cache.Invalidate();
+	}
+}
+
+bool UProneMovement::TestClearance(EProneClearanceQuery Query) const
+{
+	FVector Location;
+	FCollisionShape Shape;
+	FCollisionQueryParams CapsuleParams;
+	FCollisionResponseParams ResponseParam;
+	if (!GetClearanceQuery(Query, Location, Shape, CapsuleParams, ResponseParam))
+	{
+		return false;
+	}
+
+	return !ProneMovement::ProneQuery([&]
+	{
+		return GetWorld()->OverlapBlockingTestByChannel(Location, FQuat::Identity, UpdatedComponent->GetCollisionObjectType(), Shape, CapsuleParams, ResponseParam);
+	});
+}
+
+void UProneMovement::RequestClearance(EProneClearanceQuery Query)
+{
+	if (UProneClearanceSubsystem* ClearanceSubsystem = UWorld::GetSubsystem<UProneClearanceSubsystem>(GetWorld()))
+	{
+		ClearanceSubsystem->RequestClearance(this, Query);
+	}
+}
+
+bool UProneMovement::GetCachedClearance(EProneClearanceQuery Query, bool& bIsClear, int32 MaxFrameAge) const
+{
+	FVector Location;
+	FCollisionShape Shape;
+	FCollisionQueryParams CapsuleParams;
+	FCollisionResponseParams ResponseParam;
+	if (!GetClearanceQuery(Query, Location, Shape, CapsuleParams, ResponseParam))
+	{
+		return false;
+	}
+
+	// Only require the capsule to match, the character may have moved since the query was issued
+	const FProneClearanceResult& Result = ClearanceResults[static_cast<uint8>(Query)];
+	if (!Result.bValid || GFrameCounter - Result.FrameStamp > static_cast<uint64>(FMath::Max(0, MaxFrameAge)) ||
+		Result.Radius != Shape.GetCapsuleRadius() || Result.HalfHeight != Shape.GetCapsuleHalfHeight())
+	{
+		return false;
+	}
+
+	bIsClear = Result.bIsClear;
+	return true;
+}
+
+bool UProneMovement::GetClearanceQuery(EProneClearanceQuery Query, FVector& OutLocation, FCollisionShape& OutShape,
+	FCollisionQueryParams& OutParams, FCollisionResponseParams& OutResponseParam) const
+{
+	if (!HasValidData())
+	{
+		return false;
+	}
+
+	const UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
+	const float ComponentScale = Capsule->GetShapeScale();
+	const FVector PawnLocation = UpdatedComponent->GetComponentLocation();
+
+	OutParams = FCollisionQueryParams(SCENE_QUERY_STAT(ProneTrace), false, CharacterOwner);
+	InitCollisionParams(OutParams, OutResponseParam);
+
+	switch (Query)
+	{
+	case EProneClearanceQuery::Stand:
+	{
+		// Matches the first encroachment test in UnProne()
+		constexpr float SweepInflation = UE_KINDA_SMALL_NUMBER * 10.f;
+		OutShape = FCollisionShape::MakeCapsule(DefaultCapsule.Radius * ComponentScale, DefaultCapsule.HalfHeight * ComponentScale + SweepInflation);
+		OutLocation = PawnLocation;
+		if (bCrouchMaintainsBaseLocation)
+		{
+			OutLocation.Z += OutShape.GetCapsuleHalfHeight() - Capsule->GetScaledCapsuleHalfHeight();
+		}
+		return true;
+	}
+	case EProneClearanceQuery::Prone:
+	{
+		const FProneStanceCapsule PronedCapsule = GetStanceCapsule(EProneStance::Prone);
+		OutShape = FCollisionShape::MakeCapsule(PronedCapsule.Radius * ComponentScale, PronedCapsule.HalfHeight * ComponentScale);
+		OutLocation = PawnLocation;
+		if (bCrouchMaintainsBaseLocation)
+		{
+			OutLocation.Z -= (Capsule->GetUnscaledCapsuleHalfHeight() - PronedCapsule.HalfHeight) * ComponentScale;
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+void UProneMovement::SetCachedClearance(EProneClearanceQuery Query, const FVector& Location,
+	const FCollisionShape& Shape, uint64 FrameStamp, bool bIsClear)
+{
+	FProneClearanceResult& Result = ClearanceResults[static_cast<uint8>(Query)];
+	Result.Location = Location;
+	Result.Radius = Shape.GetCapsuleRadius();
+	Result.HalfHeight = Shape.GetCapsuleHalfHeight();
+	Result.FrameStamp = FrameStamp;
+	Result.bIsClear = bIsClear;
+	Result.bValid = true;
+}
+
 bool UProneMovement::IsProned() const
 {
 	return ProneCharacterOwner && ProneCharacterOwner->bIsProned;
@@ -172,6 +452,9 @@ bool UProneMovement::IsProned() const
 
 void UProneMovement::Prone(bool bClientSimulation)
 {
+	SCOPE_CYCLE_COUNTER(STAT_PredictedMovement_Prone);
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UProneMovement::Prone);
+
 	if (!HasValidData())
 	{
 		return;
@@ -182,6 +465,8 @@ void UProneMovement::Prone(bool bClientSimulation)
 		return;
 	}
 
+	InvalidateUnProneBlockedCache();
+
 	// See if collision is already at desired size.
 	if (CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() == PronedHalfHeight &&
 		CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleRadius() == PronedRadius)
@@ -189,17 +474,22 @@ void UProneMovement::Prone(bool bClientSimulation)
 		if (!bClientSimulation)
 		{
 			ProneCharacterOwner->bIsProned = true;
+			EndCrouchForProne();
+			ProneCharacterOwner->MarkStanceStateDirty();
 		}
+		StateRegistration.SetState(EPredictedMovementState::Proned, true);
 		ProneCharacterOwner->OnStartProne( 0.f, 0.f );
 		SetProneLock(true);
 		return;
 	}
 
+	// Defer overlap and touch processing for the resize and any resulting moves to a single update
+	FScopedMovementUpdate ScopedMovementUpdate(UpdatedComponent, bEnableScopedMovementUpdates ? EScopeUpdate::DeferredUpdates : EScopeUpdate::ImmediateUpdates);
+
 	if (bClientSimulation && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
 	{
 		// restore collision size before prone
-		const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
-		CharacterOwner->GetCapsuleComponent()->SetCapsuleSize(DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius(), DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight());
+		CharacterOwner->GetCapsuleComponent()->SetCapsuleSize(DefaultCapsule.Radius, DefaultCapsule.HalfHeight);
 		bShrinkProxyCapsule = true;
 	}
 
@@ -207,23 +497,30 @@ void UProneMovement::Prone(bool bClientSimulation)
 	const float ComponentScale = CharacterOwner->GetCapsuleComponent()->GetShapeScale();
 	const float OldUnscaledHalfHeight = CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
 	const float OldUnscaledRadius = CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleRadius();
+	const float OldScaledRadius = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	const FVector OldBaseLocation = UpdatedComponent->GetComponentLocation() - FVector(0.f, 0.f, CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
 
 	// Height is not allowed to be smaller than radius.
-	const float ClampedPronedHalfHeight = FMath::Max3(0.f, PronedRadius, PronedHalfHeight);
+	const float ClampedPronedHalfHeight = GetStanceCapsule(EProneStance::Prone).HalfHeight;
 	CharacterOwner->GetCapsuleComponent()->SetCapsuleSize(PronedRadius, ClampedPronedHalfHeight);
 	float HalfHeightAdjust = (OldUnscaledHalfHeight - ClampedPronedHalfHeight);
 	float ScaledHalfHeightAdjust = HalfHeightAdjust * ComponentScale;
 
+	bool bMovedToKeepBase = false;
 	if( !bClientSimulation )
 	{
-		// Proned to a larger height? (this is rare)
+		// Proned to a larger height? The proned half height is at least PronedRadius, so with the default dimensions this
+		// is the path taken when going prone from crouch (crouched half height 40, proned half height 60)
 		if (ClampedPronedHalfHeight > OldUnscaledHalfHeight)
 		{
 			FCollisionQueryParams CapsuleParams(SCENE_QUERY_STAT(ProneTrace), false, CharacterOwner);
 			FCollisionResponseParams ResponseParam;
 			InitCollisionParams(CapsuleParams, ResponseParam);
-			const bool bEncroached = GetWorld()->OverlapBlockingTestByChannel(UpdatedComponent->GetComponentLocation() - FVector(0.f,0.f,ScaledHalfHeightAdjust), FQuat::Identity,
-				UpdatedComponent->GetCollisionObjectType(), GetPawnCapsuleCollisionShape(SHRINK_None), CapsuleParams, ResponseParam);
+			const bool bEncroached = ProneMovement::ProneQuery([&]
+			{
+				return GetWorld()->OverlapBlockingTestByChannel(UpdatedComponent->GetComponentLocation() - FVector(0.f,0.f,ScaledHalfHeightAdjust), FQuat::Identity,
+					UpdatedComponent->GetCollisionObjectType(), GetPawnCapsuleCollisionShape(SHRINK_None), CapsuleParams, ResponseParam);
+			});
 
 			// If encroached, cancel
 			if( bEncroached )
@@ -233,10 +530,12 @@ void UProneMovement::Prone(bool bClientSimulation)
 			}
 		}
 
-		if (bCrouchMaintainsBaseLocation)
+		// A taller capsule growing in place would sink into the floor, it was tested with its base kept in place so move it there
+		if (bCrouchMaintainsBaseLocation || ScaledHalfHeightAdjust < 0.f)
 		{
 			// Intentionally not using MoveUpdatedComponent, where a horizontal plane constraint would prevent the base of the capsule from staying at the same spot.
 			UpdatedComponent->MoveComponent(FVector(0.f, 0.f, -ScaledHalfHeightAdjust), UpdatedComponent->GetComponentQuat(), true, nullptr, EMoveComponentFlags::MOVECOMP_NoFlags, ETeleportType::TeleportPhysics);
+			bMovedToKeepBase = true;
 		}
 
 		ProneCharacterOwner->bIsProned = true;
@@ -247,9 +546,14 @@ void UProneMovement::Prone(bool bClientSimulation)
 	FCollisionResponseParams ResponseParam;
 	InitCollisionParams(CapsuleParams, ResponseParam);
 	FHitResult Hit;
-	const FVector Start = UpdatedComponent->GetComponentLocation() - FVector(0.f,0.f,ScaledHalfHeightAdjust);
-	const FVector End = UpdatedComponent->GetComponentLocation() - FVector(0.f,0.f,ScaledHalfHeightAdjust * 1.01f);
-	if (GetWorld()->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, UpdatedComponent->GetCollisionObjectType(), FCollisionShape::MakeCapsule(PronedRadius, PronedHalfHeight), CapsuleParams, ResponseParam))
+	// Test where the base of the capsule was, the capsule is already there if it was moved to keep its base
+	const FVector Start = UpdatedComponent->GetComponentLocation() - FVector(0.f,0.f,bMovedToKeepBase ? 0.f : ScaledHalfHeightAdjust);
+	const FVector End = Start - FVector(0.f,0.f,ScaledHalfHeightAdjust * 0.01f);
+	const bool bHit = ProneMovement::ProneQuery([&]
+	{
+		return GetWorld()->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, UpdatedComponent->GetCollisionObjectType(), FCollisionShape::MakeCapsule(PronedRadius, PronedHalfHeight), CapsuleParams, ResponseParam);
+	});
+	if (bHit)
 	{
 		if (Hit.bStartPenetrating)
 		{
@@ -263,33 +567,66 @@ void UProneMovement::Prone(bool bClientSimulation)
 		}
 	}
 	
-	bForceNextFloorCheck = true;
+	// Only sweep for the floor again if the resize may have changed it. Prone usually widens the capsule, which always needs a new floor
+	if (bClientSimulation || !KeepFloorAfterResize(OldBaseLocation, OldScaledRadius))
+	{
+		bForceNextFloorCheck = true;
+	}
 
 	SetProneLock(true);
 
 	// OnStartProne takes the change from the Default size, not the current one (though they are usually the same).
 	const float MeshAdjust = ScaledHalfHeightAdjust;
-	const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
-	HalfHeightAdjust = (DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() - ClampedPronedHalfHeight);
+	HalfHeightAdjust = (DefaultCapsule.HalfHeight - ClampedPronedHalfHeight);
 	ScaledHalfHeightAdjust = HalfHeightAdjust * ComponentScale;
 
+	if (!bClientSimulation)
+	{
+		EndCrouchForProne();
+		ProneCharacterOwner->MarkStanceStateDirty();
+	}
+
 	AdjustProxyCapsuleSize();
+	StateRegistration.SetState(EPredictedMovementState::Proned, true);
 	ProneCharacterOwner->OnStartProne( HalfHeightAdjust, ScaledHalfHeightAdjust );
 
-	// Don't smooth this change in mesh position
+	// Don't smooth this change in mesh position, applied with the transition's cosmetics if a proxy defers them
 	if ((bClientSimulation && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy) || (IsNetMode(NM_ListenServer) && CharacterOwner->GetRemoteRole() == ROLE_AutonomousProxy))
 	{
-		FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
-		if (ClientData)
-		{
-			ClientData->MeshTranslationOffset -= FVector(0.f, 0.f, MeshAdjust);
-			ClientData->OriginalMeshTranslationOffset = ClientData->MeshTranslationOffset;
-		}
+		ProneCharacterOwner->AddProxyMeshTranslationOffset(-MeshAdjust);
+	}
+}
+
+void UProneMovement::Crouch(bool bClientSimulation)
+{
+	Super::Crouch(bClientSimulation);
+
+	if (!bClientSimulation && ProneCharacterOwner)
+	{
+		ProneCharacterOwner->MarkStanceStateDirty();
+	}
+}
+
+void UProneMovement::UnCrouch(bool bClientSimulation)
+{
+	Super::UnCrouch(bClientSimulation);
+
+	if (!bClientSimulation && ProneCharacterOwner)
+	{
+		ProneCharacterOwner->MarkStanceStateDirty();
 	}
 }
 
 void UProneMovement::UnProne(bool bClientSimulation)
 {
+	UnProneToStance(EProneStance::Stand, bClientSimulation);
+}
+
+void UProneMovement::UnProneToStance(EProneStance TargetStance, bool bClientSimulation)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PredictedMovement_UnProne);
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UProneMovement::UnProneToStance);
+
 	if (!HasValidData())
 	{
 		return;
@@ -300,17 +637,29 @@ void UProneMovement::UnProne(bool bClientSimulation)
 		return;
 	}
 
-	AProneCharacter* DefaultCharacter = ProneCharacterOwner->GetClass()->GetDefaultObject<AProneCharacter>();
+	// Sim proxies receive crouch state through replication
+	if (bClientSimulation || TargetStance != EProneStance::Crouch)
+	{
+		TargetStance = EProneStance::Stand;
+	}
+	const FProneStanceCapsule TargetCapsule = GetStanceCapsule(TargetStance);
 
 	// See if collision is already at desired size.
-	if (CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() == DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() &&
-		CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleRadius() == DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius())
+	if (CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() == TargetCapsule.HalfHeight &&
+		CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleRadius() == TargetCapsule.Radius)
 	{
 		if (!bClientSimulation)
 		{
 			ProneCharacterOwner->bIsProned = false;
+			CharacterOwner->bIsCrouched = TargetStance == EProneStance::Crouch;
+			ProneCharacterOwner->MarkStanceStateDirty();
 		}
+		StateRegistration.SetState(EPredictedMovementState::Proned, false);
 		ProneCharacterOwner->OnEndProne( 0.f, 0.f );
+		if (TargetStance == EProneStance::Crouch)
+		{
+			CharacterOwner->OnStartCrouch( 0.f, 0.f );
+		}
 		return;
 	}
 
@@ -318,15 +667,39 @@ void UProneMovement::UnProne(bool bClientSimulation)
 
 	const float ComponentScale = CharacterOwner->GetCapsuleComponent()->GetShapeScale();
 	const float OldUnscaledHalfHeight = CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
-	const float HalfHeightAdjust = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() - OldUnscaledHalfHeight;
+	const float HalfHeightAdjust = TargetCapsule.HalfHeight - OldUnscaledHalfHeight;
 	const float ScaledHalfHeightAdjust = HalfHeightAdjust * ComponentScale;
 	const FVector PawnLocation = UpdatedComponent->GetComponentLocation();
+	const FVector OldBaseLocation = PawnLocation - FVector(0.f, 0.f, CurrentPronedHalfHeight);
+	const float OldScaledRadius = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	bool bFloorCheckRequired = false;
 
 	// Grow to unproned size.
 	check(CharacterOwner->GetCapsuleComponent());
 
+	// Defer overlap and touch processing for any moves and the resize to a single update
+	FScopedMovementUpdate ScopedMovementUpdate(UpdatedComponent, bEnableScopedMovementUpdates ? EScopeUpdate::DeferredUpdates : EScopeUpdate::ImmediateUpdates);
+
 	if( !bClientSimulation )
 	{
+		// Failed under these same conditions recently, the result won't have changed
+		if (IsUnProneBlockedCached(TargetStance))
+		{
+			return;
+		}
+
+		// Baked clearance says the target stance is blocked by static geometry all around us
+		if (bUseProneClearanceField && IsMovingOnGround())
+		{
+			const UProneClearanceSubsystem* ClearanceSubsystem = UWorld::GetSubsystem<UProneClearanceSubsystem>(GetWorld());
+			const FProneStanceCapsule ScaledTargetCapsule = { TargetCapsule.Radius * ComponentScale, TargetCapsule.HalfHeight * ComponentScale };
+			if (ClearanceSubsystem && ClearanceSubsystem->IsStanceBlockedByField(OldBaseLocation, TargetStance, ScaledTargetCapsule))
+			{
+				CacheUnProneBlocked(TargetStance);
+				return;
+			}
+		}
+
 		// Try to stay in place and see if the larger capsule fits. We use a slightly taller capsule to avoid penetration.
 		const UWorld* MyWorld = GetWorld();
 		constexpr float SweepInflation = UE_KINDA_SMALL_NUMBER * 10.f;
@@ -334,15 +707,19 @@ void UProneMovement::UnProne(bool bClientSimulation)
 		FCollisionResponseParams ResponseParam;
 		InitCollisionParams(CapsuleParams, ResponseParam);
 
-		// Compensate for the difference between current capsule size and standing size
-		const FCollisionShape StandingCapsuleShape = GetPawnCapsuleCollisionShape(SHRINK_HeightCustom, -SweepInflation - ScaledHalfHeightAdjust); // Shrink by negative amount, so actually grow it.
+		// The target stance's own capsule, the proned radius is usually wider than the target's and may exceed its height
+		const FCollisionShape StandingCapsuleShape = FCollisionShape::MakeCapsule(TargetCapsule.Radius * ComponentScale,
+			TargetCapsule.HalfHeight * ComponentScale + SweepInflation);
 		const ECollisionChannel CollisionChannel = UpdatedComponent->GetCollisionObjectType();
 		bool bEncroached = true;
 
 		if (!bCrouchMaintainsBaseLocation)
 		{
 			// Expand in place
-			bEncroached = MyWorld->OverlapBlockingTestByChannel(PawnLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+			bEncroached = ProneMovement::ProneQuery([&]
+			{
+				return MyWorld->OverlapBlockingTestByChannel(PawnLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+			});
 		
 			if (bEncroached)
 			{
@@ -358,7 +735,10 @@ void UProneMovement::UnProne(bool bClientSimulation)
 
 					FHitResult Hit(1.f);
 					const FCollisionShape ShortCapsuleShape = GetPawnCapsuleCollisionShape(SHRINK_HeightCustom, ShrinkHalfHeight);
-					MyWorld->SweepSingleByChannel(Hit, PawnLocation, PawnLocation + Down, FQuat::Identity, CollisionChannel, ShortCapsuleShape, CapsuleParams);
+					ProneMovement::ProneQuery([&]
+					{
+						return MyWorld->SweepSingleByChannel(Hit, PawnLocation, PawnLocation + Down, FQuat::Identity, CollisionChannel, ShortCapsuleShape, CapsuleParams);
+					});
 					if (Hit.bStartPenetrating)
 					{
 						bEncroached = true;
@@ -368,7 +748,10 @@ void UProneMovement::UnProne(bool bClientSimulation)
 						// Compute where the base of the sweep ended up, and see if we can stand there
 						const float DistanceToBase = (Hit.Time * TraceDist) + ShortCapsuleShape.Capsule.HalfHeight;
 						const FVector NewLoc = FVector(PawnLocation.X, PawnLocation.Y, PawnLocation.Z - DistanceToBase + StandingCapsuleShape.Capsule.HalfHeight + SweepInflation + MIN_FLOOR_DIST / 2.f);
-						bEncroached = MyWorld->OverlapBlockingTestByChannel(NewLoc, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+						bEncroached = ProneMovement::ProneQuery([&]
+						{
+							return MyWorld->OverlapBlockingTestByChannel(NewLoc, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+						});
 						if (!bEncroached)
 						{
 							// Intentionally not using MoveUpdatedComponent, where a horizontal plane constraint would prevent the base of the capsule from staying at the same spot.
@@ -382,7 +765,10 @@ void UProneMovement::UnProne(bool bClientSimulation)
 		{
 			// Expand while keeping base location the same.
 			FVector StandingLocation = PawnLocation + FVector(0.f, 0.f, StandingCapsuleShape.GetCapsuleHalfHeight() - CurrentPronedHalfHeight);
-			bEncroached = MyWorld->OverlapBlockingTestByChannel(StandingLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+			bEncroached = ProneMovement::ProneQuery([&]
+			{
+				return MyWorld->OverlapBlockingTestByChannel(StandingLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+			});
 
 			if (bEncroached)
 			{
@@ -393,7 +779,10 @@ void UProneMovement::UnProne(bool bClientSimulation)
 					if (CurrentFloor.bBlockingHit && CurrentFloor.FloorDist > MinFloorDist)
 					{
 						StandingLocation.Z -= CurrentFloor.FloorDist - MinFloorDist;
-						bEncroached = MyWorld->OverlapBlockingTestByChannel(StandingLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+						bEncroached = ProneMovement::ProneQuery([&]
+						{
+							return MyWorld->OverlapBlockingTestByChannel(StandingLocation, FQuat::Identity, CollisionChannel, StandingCapsuleShape, CapsuleParams, ResponseParam);
+						});
 					}
 				}				
 			}
@@ -402,17 +791,21 @@ void UProneMovement::UnProne(bool bClientSimulation)
 			{
 				// Commit the change in location.
 				UpdatedComponent->MoveComponent(StandingLocation - PawnLocation, UpdatedComponent->GetComponentQuat(), false, nullptr, EMoveComponentFlags::MOVECOMP_NoFlags, ETeleportType::TeleportPhysics);
-				bForceNextFloorCheck = true;
+				bFloorCheckRequired = true;
 			}
 		}
 
 		// If still encroached then abort.
 		if (bEncroached)
 		{
+			CacheUnProneBlocked(TargetStance);
 			return;
 		}
 
+		InvalidateUnProneBlockedCache();
 		ProneCharacterOwner->bIsProned = false;
+		CharacterOwner->bIsCrouched = TargetStance == EProneStance::Crouch;
+		ProneCharacterOwner->MarkStanceStateDirty();
 	}	
 	else
 	{
@@ -420,22 +813,97 @@ void UProneMovement::UnProne(bool bClientSimulation)
 	}
 
 	// Now call SetCapsuleSize() to cause touch/untouch events and actually grow the capsule
-	CharacterOwner->GetCapsuleComponent()->SetCapsuleSize(DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius(), DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight(), true);
+	CharacterOwner->GetCapsuleComponent()->SetCapsuleSize(TargetCapsule.Radius, TargetCapsule.HalfHeight, true);
+
+	// Only sweep for the floor again if the resize may have changed it
+	if (bFloorCheckRequired && !KeepFloorAfterResize(OldBaseLocation, OldScaledRadius))
+	{
+		bForceNextFloorCheck = true;
+	}
 
 	const float MeshAdjust = ScaledHalfHeightAdjust;
 	AdjustProxyCapsuleSize();
+	StateRegistration.SetState(EPredictedMovementState::Proned, false);
 	ProneCharacterOwner->OnEndProne( HalfHeightAdjust, ScaledHalfHeightAdjust );
 
-	// Don't smooth this change in mesh position
+	if (TargetStance == EProneStance::Crouch)
+	{
+		// OnStartCrouch takes the change from the Default size
+		const float CrouchHalfHeightAdjust = DefaultCapsule.HalfHeight - TargetCapsule.HalfHeight;
+		CharacterOwner->OnStartCrouch( CrouchHalfHeightAdjust, CrouchHalfHeightAdjust * ComponentScale );
+	}
+
+	// Don't smooth this change in mesh position, applied with the transition's cosmetics if a proxy defers them
 	if ((bClientSimulation && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy) || (IsNetMode(NM_ListenServer) && CharacterOwner->GetRemoteRole() == ROLE_AutonomousProxy))
 	{
-		FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
-		if (ClientData)
-		{
-			ClientData->MeshTranslationOffset += FVector(0.f, 0.f, MeshAdjust);
-			ClientData->OriginalMeshTranslationOffset = ClientData->MeshTranslationOffset;
-		}
+		ProneCharacterOwner->AddProxyMeshTranslationOffset(MeshAdjust);
+	}
+}
+
+void UProneMovement::EndCrouchForProne()
+{
+	if (!CharacterOwner->bIsCrouched)
+	{
+		return;
+	}
+
+	// Leave crouch without first growing to the standing capsule, the prone resize already happened
+	// OnEndCrouch takes the change from the Default size
+	CharacterOwner->bIsCrouched = false;
+	ProneCharacterOwner->MarkStanceStateDirty();
+	const float HalfHeightAdjust = DefaultCapsule.HalfHeight - GetStanceCapsule(EProneStance::Crouch).HalfHeight;
+	CharacterOwner->OnEndCrouch( HalfHeightAdjust, HalfHeightAdjust * CharacterOwner->GetCapsuleComponent()->GetShapeScale() );
+}
+
+bool UProneMovement::KeepFloorAfterResize(const FVector& OldBaseLocation, float OldScaledRadius)
+{
+	if (!CurrentFloor.IsWalkableFloor() || !CurrentFloor.bBlockingHit)
+	{
+		return false;
+	}
+
+	float ScaledRadius, ScaledHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(ScaledRadius, ScaledHalfHeight);
+
+	// A wider capsule may rest on geometry the previous floor sweep never considered
+	if (ScaledRadius > OldScaledRadius)
+	{
+		return false;
+	}
+
+	// The floor contact must still be under the narrower capsule
+	const FVector PawnLocation = UpdatedComponent->GetComponentLocation();
+	if ((CurrentFloor.HitResult.ImpactPoint - PawnLocation).SizeSquared2D() > FMath::Square(ScaledRadius))
+	{
+		return false;
+	}
+
+	// Any horizontal movement needs a new sweep
+	const FVector NewBaseLocation = PawnLocation - FVector(0.f, 0.f, ScaledHalfHeight);
+	if (!FVector2D(NewBaseLocation).Equals(FVector2D(OldBaseLocation), UE_KINDA_SMALL_NUMBER))
+	{
+		return false;
+	}
+
+	// On a sloped planar floor the hemisphere touches Radius * (1 / NormalZ - 1) above the base, so a narrower capsule
+	// sits further from the floor. The new floor distance follows from that and the vertical movement of the base.
+	const float NormalZ = CurrentFloor.HitResult.ImpactNormal.Z;
+	const float SlopeOffset = NormalZ > UE_KINDA_SMALL_NUMBER ? (OldScaledRadius - ScaledRadius) * (1.f / NormalZ - 1.f) : 0.f;
+	const float DeltaZ = NewBaseLocation.Z - OldBaseLocation.Z + SlopeOffset;
+	const float NewFloorDist = CurrentFloor.FloorDist + DeltaZ;
+
+	// Outside of this range the walking code would adjust the floor height, which needs a fresh floor result
+	if (NewFloorDist < MIN_FLOOR_DIST || NewFloorDist > MAX_FLOOR_DIST)
+	{
+		return false;
+	}
+
+	CurrentFloor.FloorDist = NewFloorDist;
+	if (CurrentFloor.bLineTrace)
+	{
+		CurrentFloor.LineDist += NewBaseLocation.Z - OldBaseLocation.Z;
 	}
+	return true;
 }
 
 bool UProneMovement::CanProneInCurrentState() const
@@ -445,6 +913,8 @@ bool UProneMovement::CanProneInCurrentState() const
 
 void UProneMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UProneMovement::UpdateCharacterStateBeforeMovement);
+
 	// Proxies get replicated crouch state.
 	if (CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
 	{
@@ -458,12 +928,12 @@ void UProneMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 		{
 			if (IsProned())
 			{
+				// Go directly from the proned capsule to the crouched capsule, potential prone lock
 				bWantsToProne = false;
-				UnProne(false);
+				UnProneToStance(EProneStance::Crouch, false);
 			}
-			if (!IsProned())
+			else
 			{
-				// Potential prone lock
 				Crouch(false);
 			}
 		}
@@ -486,10 +956,10 @@ void UProneMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 		}
 		else if (!bIsProned && bWantsToProne && CanProneInCurrentState())
 		{
+			// Prone() goes directly from the crouched capsule to the proned capsule
 			if (IsCrouching())
 			{
 				bWantsToCrouch = false;
-				UnCrouch(false);
 			}
 			Prone(false);
 		}
@@ -498,6 +968,8 @@ void UProneMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 
 void UProneMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UProneMovement::UpdateCharacterStateAfterMovement);
+
 	Super::UpdateCharacterStateAfterMovement(DeltaSeconds);
 
 	// Proxies get replicated Prone state.
@@ -511,15 +983,55 @@ void UProneMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 	}
 }
 
+void UProneMovement::MoveAutonomous(float ClientTimeStamp, float DeltaTime, uint8 CompressedFlags, const FVector& NewAccel)
+{
+	// Saved moves are replayed through here, the server performs each move at its own timestamp too
+	if (bClientUpdating)
+	{
+		ReplayedMoveTimestamp = ClientTimeStamp;
+	}
+
+	Super::MoveAutonomous(ClientTimeStamp, DeltaTime, CompressedFlags, NewAccel);
+}
+
 bool UProneMovement::ClientUpdatePositionAfterServerUpdate()
 {
+	PREDICTED_MOVEMENT_REPLAY_SCOPE(*this);
+
 	const bool bRealProne = bWantsToProne;
+
+	// Replayed moves must run the same clearance tests the server ran
+	InvalidateUnProneBlockedCache();
+
 	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
 	bWantsToProne = bRealProne;
+	ReplayedMoveTimestamp = -1.f;
 
 	return bResult;
 }
 
+void UProneMovement::ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment)
+{
+	// The client clears its cache before replaying from the corrected move, so moves after it start from the same state
+	if (!PendingAdjustment.bAckGoodMove)
+	{
+		InvalidateUnProneBlockedCache();
+	}
+
+	Super::ServerSendMoveResponse(PendingAdjustment);
+}
+
+bool UProneMovement::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	if (Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode))
+	{
+		PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(*this, ClientWorldLocation, RelativeClientLocation, ClientMovementBase,
+			ClientBaseBoneName, ClientMovementMode);
+		return true;
+	}
+	return false;
+}
+
 void FSavedMove_Character_Prone::Clear()
 {
 	Super::Clear();
@@ -4,7 +4,9 @@
 #include "Sprint/SprintCharacter.h"
 
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "Sprint/SprintMovement.h"
+#include "System/PredictedMovementCosmetics.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(SprintCharacter)
 
@@ -18,7 +20,11 @@ void ASprintCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& Out
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME_CONDITION(ThisClass, bIsSprinting, COND_SimulatedOnly);
+	FDoRepLifetimeParams SharedParams;
+	SharedParams.bIsPushBased = true;
+	SharedParams.Condition = COND_SimulatedOnly;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(ThisClass, bIsSprinting, SharedParams);
 }
 
 void ASprintCharacter::OnRep_IsSprinting()
@@ -57,10 +63,16 @@ void ASprintCharacter::UnSprint(bool bClientSimulation)
 
 void ASprintCharacter::OnEndSprint()
 {
-	K2_OnEndSprint();
+	if (!PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		K2_OnEndSprint();
+	}
 }
 
 void ASprintCharacter::OnStartSprint()
 {
-	K2_OnStartSprint();
+	if (!PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		K2_OnStartSprint();
+	}
 }
\ No newline at end of file
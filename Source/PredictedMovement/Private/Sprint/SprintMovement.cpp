@@ -3,7 +3,11 @@
 
 #include "Sprint/SprintMovement.h"
 
+#include "Net/Core/PushModel/PushModel.h"
 #include "Sprint/SprintCharacter.h"
+#include "System/PredictedMovementCorrections.h"
+#include "System/PredictedMovementKernel.h"
+#include "System/PredictedMovementTrace.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(SprintMovement)
 
@@ -41,6 +45,52 @@ void USprintMovement::SetUpdatedComponent(USceneComponent* NewUpdatedComponent)
 	SprintCharacterOwner = Cast<ASprintCharacter>(PawnOwner);
 }
 
+void USprintMovement::BeginPlay()
+{
+	Super::BeginPlay();
+
+	StateRegistration.Register(this);
+}
+
+void USprintMovement::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StateRegistration.Unregister();
+	Journal.Flush();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void USprintMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		StateSnapshot.Publish(Snapshot);
+	}
+}
+
+void USprintMovement::PerformMovement(float DeltaTime)
+{
+	Super::PerformMovement(DeltaTime);
+
+	if (FPredictedMovementJournal::IsEnabled() && HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		Journal.Record(this, Snapshot);
+	}
+}
+
+void USprintMovement::FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const
+{
+	Snapshot.bIsCrouched = IsCrouching();
+	Snapshot.bIsSprinting = IsSprinting();
+}
+
 bool USprintMovement::IsSprintingAtSpeed() const
 {
 	if (!IsSprinting())
@@ -48,14 +98,17 @@ bool USprintMovement::IsSprintingAtSpeed() const
 		return false;
 	}
 
-	// When moving on ground we want to factor moving uphill or downhill so variations in terrain
-	// aren't culled from the check. When falling, we don't want to factor fall velocity, only lateral
-	const float Vel = IsMovingOnGround() ? Velocity.SizeSquared() : Velocity.SizeSquared2D();
 	const float WalkSpeed = IsCrouching() ? MaxWalkSpeedCrouched : MaxWalkSpeed;
+	return IsVelocityAtSprintSpeed(Velocity, IsMovingOnGround(), WalkSpeed, VelocityCheckMitigatorSprinting);
+}
 
-	// When struggling to surpass walk speed, which can occur with heavy rotation and low acceleration, we
-	// mitigate the check so there isn't a constant re-entry that can occur as an edge case
-	return Vel >= (WalkSpeed * WalkSpeed * VelocityCheckMitigatorSprinting);
+bool USprintMovement::IsVelocityAtSprintSpeed(const FVector& InVelocity, bool bMovingOnGround, float WalkSpeed,
+	float VelocityCheckMitigator)
+{
+	// When moving on ground we want to factor moving uphill or downhill so variations in terrain
+	// aren't culled from the check. When falling, we don't want to factor fall velocity, only lateral
+	const float Vel = bMovingOnGround ? InVelocity.SizeSquared() : InVelocity.SizeSquared2D();
+	return PredictedMovementKernel::IsSprintingAtSpeed(Vel, WalkSpeed, VelocityCheckMitigator);
 }
 
 float USprintMovement::GetMaxAcceleration() const
@@ -110,6 +163,8 @@ bool USprintMovement::IsSprinting() const
 
 void USprintMovement::Sprint(bool bClientSimulation)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(USprintMovement::Sprint);
+
 	if (!HasValidData())
 	{
 		return;
@@ -123,12 +178,16 @@ void USprintMovement::Sprint(bool bClientSimulation)
 	if (!bClientSimulation)
 	{
 		SprintCharacterOwner->bIsSprinting = true;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ASprintCharacter, bIsSprinting, SprintCharacterOwner);
 	}
+	StateRegistration.SetState(EPredictedMovementState::Sprinting, true);
 	SprintCharacterOwner->OnStartSprint();
 }
 
 void USprintMovement::UnSprint(bool bClientSimulation)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(USprintMovement::UnSprint);
+
 	if (!HasValidData())
 	{
 		return;
@@ -137,7 +196,9 @@ void USprintMovement::UnSprint(bool bClientSimulation)
 	if (!bClientSimulation)
 	{
 		SprintCharacterOwner->bIsSprinting = false;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ASprintCharacter, bIsSprinting, SprintCharacterOwner);
 	}
+	StateRegistration.SetState(EPredictedMovementState::Sprinting, false);
 	SprintCharacterOwner->OnEndSprint();
 }
 
@@ -163,25 +224,19 @@ bool USprintMovement::CanSprintInCurrentState() const
 
 bool USprintMovement::IsSprintWithinAllowableInputAngle() const
 {
-	// This check ensures that we are not sprinting backward or sideways, while allowing leeway 
-	// This angle allows sprinting when holding forward, forward left, forward right
-	// but not left or right or backward)
-	static constexpr float MaxSprintInputDegrees = 50.f;
-	static constexpr float MaxSprintInputNormal = 0.64278732;  // cos(rad(MaxSprintInputDegrees))
+	return IsInputWithinSprintAngle(GetCurrentAcceleration(), UpdatedComponent->GetForwardVector());
+}
 
-	if constexpr (MaxSprintInputDegrees > 0.f)
-	{
-		const float Dot = (GetCurrentAcceleration().GetSafeNormal2D() | UpdatedComponent->GetForwardVector());
-		if (Dot < MaxSprintInputNormal)
-		{
-			return false;
-		}
-	}
-	return true;
+bool USprintMovement::IsInputWithinSprintAngle(const FVector& InAcceleration, const FVector& Forward)
+{
+	const float Dot = (InAcceleration.GetSafeNormal2D() | Forward);
+	return PredictedMovementKernel::IsSprintWithinAllowableInputAngle(Dot);
 }
 
 void USprintMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(USprintMovement::UpdateCharacterStateBeforeMovement);
+
 	// Proxies get replicated Sprint state.
 	if (CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
 	{
@@ -202,6 +257,8 @@ void USprintMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 
 void USprintMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(USprintMovement::UpdateCharacterStateAfterMovement);
+
 	// Proxies get replicated Sprint state.
 	if (CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
 	{
@@ -217,6 +274,8 @@ void USprintMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 
 bool USprintMovement::ClientUpdatePositionAfterServerUpdate()
 {
+	PREDICTED_MOVEMENT_REPLAY_SCOPE(*this);
+
 	const bool bRealSprint = bWantsToSprint;
 	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
 	bWantsToSprint = bRealSprint;
@@ -224,6 +283,17 @@ bool USprintMovement::ClientUpdatePositionAfterServerUpdate()
 	return bResult;
 }
 
+bool USprintMovement::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	if (Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode))
+	{
+		PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(*this, ClientWorldLocation, RelativeClientLocation, ClientMovementBase,
+			ClientBaseBoneName, ClientMovementMode);
+		return true;
+	}
+	return false;
+}
+
 void FSavedMove_Character_Sprint::Clear()
 {
 	Super::Clear();
@@ -4,9 +4,16 @@
 #include "Stamina/StaminaMovement.h"
 
 #include "GameFramework/Character.h"
+#include "System/PredictedMovementBandwidth.h"
+#include "System/PredictedMovementCorrections.h"
+#include "System/PredictedMovementKernel.h"
+#include "System/PredictedMovementStats.h"
+#include "System/PredictedMovementTrace.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(StaminaMovement)
 
+DECLARE_CYCLE_STAT(TEXT("Stamina ServerCheckClientError"), STAT_PredictedMovement_StaminaServerCheckClientError, STATGROUP_PredictedMovement);
+
 void FStaminaMoveResponseDataContainer::ServerFillResponseData(
 	const UCharacterMovementComponent& CharacterMovement, const FClientAdjustment& PendingAdjustment)
 {
@@ -29,8 +36,12 @@ bool FStaminaMoveResponseDataContainer::Serialize(UCharacterMovementComponent& C
 	// Server ➜ Client
 	if (IsCorrection())
 	{
+		PREDICTED_MOVEMENT_BANDWIDTH_SCOPE(CharacterMovement, Ar, EPredictedMovementNetChannel::StaminaCorrection);
 		Ar << Stamina;
-		Ar << bStaminaDrained;
+
+		uint8 bDrained = bStaminaDrained ? 1 : 0;
+		Ar.SerializeBits(&bDrained, 1);
+		bStaminaDrained = bDrained != 0;
 	}
 
 	return !Ar.IsError();
@@ -56,6 +67,8 @@ bool FStaminaNetworkMoveData::Serialize(UCharacterMovementComponent& CharacterMo
     Super::Serialize(CharacterMovement, Ar, PackageMap, MoveType);
 
 	// Client ➜ Server
+	PREDICTED_MOVEMENT_BANDWIDTH_SCOPE(CharacterMovement, Ar, EPredictedMovementNetChannel::StaminaMove);
+	// Full precision for ServerCheckClientError, 1 bit when empty and 33 bits otherwise
     SerializeOptionalValue<float>(Ar.IsSaving(), Ar, Stamina, 0.f);
     return !Ar.IsError();
 }
@@ -69,15 +82,68 @@ UStaminaMovement::UStaminaMovement(const FObjectInitializer& ObjectInitializer)
 	NetworkStaminaCorrectionThreshold = 2.f;
 }
 
+void UStaminaMovement::BeginPlay()
+{
+	Super::BeginPlay();
+
+	StateRegistration.Register(this);
+	StateRegistration.SetStamina(Stamina);
+	StateRegistration.SetState(EPredictedMovementState::StaminaDrained, bStaminaDrained);
+}
+
+void UStaminaMovement::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StateRegistration.Unregister();
+	Journal.Flush();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UStaminaMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		StateSnapshot.Publish(Snapshot);
+	}
+}
+
+void UStaminaMovement::PerformMovement(float DeltaTime)
+{
+	Super::PerformMovement(DeltaTime);
+
+	if (FPredictedMovementJournal::IsEnabled() && HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		Journal.Record(this, Snapshot);
+	}
+}
+
+void UStaminaMovement::FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const
+{
+	Snapshot.bIsCrouched = IsCrouching();
+	Snapshot.bIsStaminaDrained = IsStaminaDrained();
+	Snapshot.Stamina = GetStamina();
+	Snapshot.MaxStamina = GetMaxStamina();
+}
+
 void UStaminaMovement::SetStamina(float NewStamina)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UStaminaMovement::SetStamina);
+
 	const float PrevStamina = Stamina;
-	Stamina = FMath::Clamp(NewStamina, 0.f, MaxStamina);
+	Stamina = PredictedMovementKernel::ClampStamina(NewStamina, MaxStamina);
 	if (CharacterOwner != nullptr)
 	{
 		if (!FMath::IsNearlyEqual(PrevStamina, Stamina))
 		{
 			OnStaminaChanged(PrevStamina, Stamina);
+			StateRegistration.SetStamina(Stamina);
 		}
 	}
 }
@@ -103,6 +169,7 @@ void UStaminaMovement::SetStaminaDrained(bool bNewValue)
 	{
 		if (bWasStaminaDrained != bStaminaDrained)
 		{
+			StateRegistration.SetState(EPredictedMovementState::StaminaDrained, bStaminaDrained);
 			if (bStaminaDrained)
 			{
 				OnStaminaDrained();
@@ -117,32 +184,18 @@ void UStaminaMovement::SetStaminaDrained(bool bNewValue)
 
 void UStaminaMovement::OnStaminaChanged(float PrevValue, float NewValue)
 {
-	if (FMath::IsNearlyZero(Stamina))
+	const bool bNewStaminaDrained = ResolveStaminaDrained(Stamina, MaxStamina, bStaminaDrained);
+	if (bNewStaminaDrained != bStaminaDrained)
 	{
-		Stamina = 0.f;
-		if (!bStaminaDrained)
-		{
-			SetStaminaDrained(true);
-		}
-	}
-	// This will need to change if not using MaxStamina for recovery, here is an example (commented out) that uses
-	// 10% instead; to use this, comment out the existing else if statement, and change the 0.1f to the percentage
-	// you want to use (0.1f is 10%)
-	//
-	// else if (bStaminaDrained && Stamina >= MaxStamina * 0.1f)
-	// {
-	// 	SetStaminaDrained(false);
-	// }
-	else if (FMath::IsNearlyEqual(Stamina, MaxStamina))
-	{
-		Stamina = MaxStamina;
-		if (bStaminaDrained)
-		{
-			SetStaminaDrained(false);
-		}
+		SetStaminaDrained(bNewStaminaDrained);
 	}
 }
 
+bool UStaminaMovement::ResolveStaminaDrained(float& InOutStamina, float InMaxStamina, bool bInStaminaDrained)
+{
+	return PredictedMovementKernel::ResolveStaminaDrained(InOutStamina, InMaxStamina, bInStaminaDrained);
+}
+
 bool FSavedMove_Character_Stamina::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter,
 	float MaxDelta) const
 {
@@ -213,10 +266,20 @@ void UStaminaMovement::OnClientCorrectionReceived(FNetworkPredictionData_Client_
 #endif
 }
 
+bool UStaminaMovement::ClientUpdatePositionAfterServerUpdate()
+{
+	PREDICTED_MOVEMENT_REPLAY_SCOPE(*this);
+	return Super::ClientUpdatePositionAfterServerUpdate();
+}
+
 bool UStaminaMovement::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
 {
+	SCOPE_CYCLE_COUNTER(STAT_PredictedMovement_StaminaServerCheckClientError);
+
     if (Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode))
     {
+		PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(*this, ClientWorldLocation, RelativeClientLocation, ClientMovementBase,
+			ClientBaseBoneName, ClientMovementMode);
         return true;
     }
     
@@ -225,6 +288,8 @@ bool UStaminaMovement::ServerCheckClientError(float ClientTimeStamp, float Delta
     const FStaminaNetworkMoveData* CurrentMoveData = static_cast<const FStaminaNetworkMoveData*>(GetCurrentNetworkMoveData());
     if (!FMath::IsNearlyEqual(CurrentMoveData->Stamina, Stamina, NetworkStaminaCorrectionThreshold))
     {
+		PREDICTED_MOVEMENT_RECORD_CORRECTION(*this, EPredictedMovementCorrectionCause::Stamina,
+			FMath::Abs(CurrentMoveData->Stamina - Stamina));
         return true;
     }
     
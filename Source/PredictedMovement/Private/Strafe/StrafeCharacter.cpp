@@ -4,7 +4,9 @@
 #include "Strafe/StrafeCharacter.h"
 
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "Strafe/StrafeMovement.h"
+#include "System/PredictedMovementCosmetics.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(StrafeCharacter)
 
@@ -18,7 +20,11 @@ void AStrafeCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& Out
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME_CONDITION(ThisClass, bIsStrafing, COND_SimulatedOnly);
+	FDoRepLifetimeParams SharedParams;
+	SharedParams.bIsPushBased = true;
+	SharedParams.Condition = COND_SimulatedOnly;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(ThisClass, bIsStrafing, SharedParams);
 }
 
 void AStrafeCharacter::OnRep_IsStrafing()
@@ -65,10 +71,16 @@ bool AStrafeCharacter::CanStrafe() const
 
 void AStrafeCharacter::OnEndStrafe()
 {
-	K2_OnEndStrafe();
+	if (!PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		K2_OnEndStrafe();
+	}
 }
 
 void AStrafeCharacter::OnStartStrafe()
 {
-	K2_OnStartStrafe();
+	if (!PredictedMovement::ShouldSkipCosmetics(this))
+	{
+		K2_OnStartStrafe();
+	}
 }
\ No newline at end of file
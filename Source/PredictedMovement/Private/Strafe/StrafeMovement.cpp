@@ -3,7 +3,10 @@
 
 #include "Strafe/StrafeMovement.h"
 
+#include "Net/Core/PushModel/PushModel.h"
 #include "Strafe/StrafeCharacter.h"
+#include "System/PredictedMovementCorrections.h"
+#include "System/PredictedMovementTrace.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(StrafeMovement)
 
@@ -38,6 +41,52 @@ void UStrafeMovement::SetUpdatedComponent(USceneComponent* NewUpdatedComponent)
 	StrafeCharacterOwner = Cast<AStrafeCharacter>(PawnOwner);
 }
 
+void UStrafeMovement::BeginPlay()
+{
+	Super::BeginPlay();
+
+	StateRegistration.Register(this);
+}
+
+void UStrafeMovement::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StateRegistration.Unregister();
+	Journal.Flush();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UStrafeMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		StateSnapshot.Publish(Snapshot);
+	}
+}
+
+void UStrafeMovement::PerformMovement(float DeltaTime)
+{
+	Super::PerformMovement(DeltaTime);
+
+	if (FPredictedMovementJournal::IsEnabled() && HasValidData())
+	{
+		FPredictedMovementSnapshot Snapshot;
+		FillStateSnapshot(Snapshot);
+		Journal.Record(this, Snapshot);
+	}
+}
+
+void UStrafeMovement::FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const
+{
+	Snapshot.bIsCrouched = IsCrouching();
+	Snapshot.bIsStrafing = IsStrafing();
+}
+
 float UStrafeMovement::GetMaxAcceleration() const
 {
 	if (IsStrafing() && IsMovingOnGround())
@@ -90,6 +139,8 @@ bool UStrafeMovement::IsStrafing() const
 
 void UStrafeMovement::Strafe(bool bClientSimulation)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UStrafeMovement::Strafe);
+
 	if (!HasValidData())
 	{
 		return;
@@ -103,12 +154,16 @@ void UStrafeMovement::Strafe(bool bClientSimulation)
 	if (!bClientSimulation)
 	{
 		StrafeCharacterOwner->bIsStrafing = true;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AStrafeCharacter, bIsStrafing, StrafeCharacterOwner);
 	}
+	StateRegistration.SetState(EPredictedMovementState::Strafing, true);
 	StrafeCharacterOwner->OnStartStrafe();
 }
 
 void UStrafeMovement::UnStrafe(bool bClientSimulation)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UStrafeMovement::UnStrafe);
+
 	if (!HasValidData())
 	{
 		return;
@@ -117,7 +172,9 @@ void UStrafeMovement::UnStrafe(bool bClientSimulation)
 	if (!bClientSimulation)
 	{
 		StrafeCharacterOwner->bIsStrafing = false;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AStrafeCharacter, bIsStrafing, StrafeCharacterOwner);
 	}
+	StateRegistration.SetState(EPredictedMovementState::Strafing, false);
 	StrafeCharacterOwner->OnEndStrafe();
 }
 
@@ -128,6 +185,8 @@ bool UStrafeMovement::CanStrafeInCurrentState() const
 
 void UStrafeMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UStrafeMovement::UpdateCharacterStateBeforeMovement);
+
 	// Proxies get replicated Strafe state.
 	if (CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
 	{
@@ -148,6 +207,8 @@ void UStrafeMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
 
 void UStrafeMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 {
+	PREDICTED_MOVEMENT_TRACE_SCOPE(UStrafeMovement::UpdateCharacterStateAfterMovement);
+
 	// Proxies get replicated Strafe state.
 	if (CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
 	{
@@ -163,6 +224,8 @@ void UStrafeMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
 
 bool UStrafeMovement::ClientUpdatePositionAfterServerUpdate()
 {
+	PREDICTED_MOVEMENT_REPLAY_SCOPE(*this);
+
 	const bool bRealStrafe = bWantsToStrafe;
 	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
 	bWantsToStrafe = bRealStrafe;
@@ -170,6 +233,17 @@ bool UStrafeMovement::ClientUpdatePositionAfterServerUpdate()
 	return bResult;
 }
 
+bool UStrafeMovement::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	if (Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode))
+	{
+		PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(*this, ClientWorldLocation, RelativeClientLocation, ClientMovementBase,
+			ClientBaseBoneName, ClientMovementMode);
+		return true;
+	}
+	return false;
+}
+
 void FSavedMove_Character_Strafe::Clear()
 {
 	Super::Clear();
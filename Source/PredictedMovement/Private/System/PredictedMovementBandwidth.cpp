@@ -0,0 +1,160 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementBandwidth.h"
+
+#if PREDICTED_MOVEMENT_BANDWIDTH_STATS
+
+#include "Engine/NetConnection.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+#include "System/PredictedMovementStats.h"
+#include "UObject/ObjectKey.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stamina Move Bits"), STAT_PredictedMovement_StaminaMoveBits, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stamina Correction Bits"), STAT_PredictedMovement_StaminaCorrectionBits, STATGROUP_PredictedMovement);
+
+CSV_DEFINE_CATEGORY(PredictedMovementBandwidth, true);
+
+DEFINE_LOG_CATEGORY_STATIC(LogPredictedMovementBandwidth, Log, All);
+
+namespace PredictedMovementBandwidth
+{
+	struct FConnectionBits
+	{
+		FString Description;
+		int64 Sent[static_cast<uint8>(EPredictedMovementNetChannel::MAX)] = {};
+		int64 Received[static_cast<uint8>(EPredictedMovementNetChannel::MAX)] = {};
+	};
+
+	/** Totals since the last reset, for every open connection that has sent or received move data */
+	static TMap<TObjectKey<UNetConnection>, FConnectionBits> Connections;
+
+	/** Drop the totals of connections that were closed or destroyed */
+	static void PruneConnections()
+	{
+		for (auto It = Connections.CreateIterator(); It; ++It)
+		{
+			const UNetConnection* Connection = It.Key().ResolveObjectPtr();
+			if (!IsValid(Connection) || Connection->GetConnectionState() == USOCK_Closed)
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	static const TCHAR* GetChannelName(EPredictedMovementNetChannel Channel)
+	{
+		switch (Channel)
+		{
+		case EPredictedMovementNetChannel::StaminaMove: return TEXT("StaminaMove");
+		case EPredictedMovementNetChannel::StaminaCorrection: return TEXT("StaminaCorrection");
+		default: return TEXT("Unknown");
+		}
+	}
+
+	static void DumpConnections(const TArray<FString>& Args)
+	{
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Connections.Reset();
+			return;
+		}
+
+		PruneConnections();
+		for (const TPair<TObjectKey<UNetConnection>, FConnectionBits>& Pair : Connections)
+		{
+			UE_LOG(LogPredictedMovementBandwidth, Log, TEXT("%s"), *Pair.Value.Description);
+			for (uint8 Channel = 0; Channel < static_cast<uint8>(EPredictedMovementNetChannel::MAX); ++Channel)
+			{
+				UE_LOG(LogPredictedMovementBandwidth, Log, TEXT("    %s: sent %lld bits, received %lld bits"),
+					GetChannelName(static_cast<EPredictedMovementNetChannel>(Channel)), Pair.Value.Sent[Channel], Pair.Value.Received[Channel]);
+			}
+		}
+	}
+
+	static FAutoConsoleCommand BandwidthCommand(
+		TEXT("p.PredictedMovement.Bandwidth"),
+		TEXT("Log the bits each shell has added to move traffic, per connection. Pass 'reset' to clear the totals."),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&DumpConnections));
+
+	/**
+	 * The character movement component serializes move data with FNetBitWriter / FNetBitReader, which are the only
+	 * archives flagged as net archives that reach the move data. Anything else is not measured.
+	 */
+	static bool CanMeasure(const FArchive& Ar)
+	{
+		return Ar.IsNetArchive() && (Ar.IsSaving() || Ar.IsLoading());
+	}
+
+	/** Only valid if CanMeasure(Ar) */
+	static int64 GetBitPosition(FArchive& Ar)
+	{
+		return Ar.IsSaving() ? static_cast<FBitWriter&>(Ar).GetNumBits() : static_cast<FBitReader&>(Ar).GetPosBits();
+	}
+}
+
+PredictedMovementBandwidth::FScope::FScope(const UCharacterMovementComponent& InMovement, FArchive& InAr,
+	EPredictedMovementNetChannel InChannel)
+	: Movement(InMovement)
+	, Ar(InAr)
+	, Channel(InChannel)
+	, bMeasure(CanMeasure(InAr))
+	, StartBits(bMeasure ? GetBitPosition(InAr) : 0)
+{}
+
+PredictedMovementBandwidth::FScope::~FScope()
+{
+	if (!bMeasure)
+	{
+		return;
+	}
+
+	const int64 Bits = GetBitPosition(Ar) - StartBits;
+	if (Bits <= 0 || Ar.IsError())
+	{
+		return;
+	}
+
+	switch (Channel)
+	{
+	case EPredictedMovementNetChannel::StaminaMove:
+		INC_DWORD_STAT_BY(STAT_PredictedMovement_StaminaMoveBits, Bits);
+		CSV_CUSTOM_STAT(PredictedMovementBandwidth, StaminaMoveBits, static_cast<int32>(Bits), ECsvCustomStatOp::Accumulate);
+		break;
+	case EPredictedMovementNetChannel::StaminaCorrection:
+		INC_DWORD_STAT_BY(STAT_PredictedMovement_StaminaCorrectionBits, Bits);
+		CSV_CUSTOM_STAT(PredictedMovementBandwidth, StaminaCorrectionBits, static_cast<int32>(Bits), ECsvCustomStatOp::Accumulate);
+		break;
+	default:
+		break;
+	}
+
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	UNetConnection* Connection = Character ? Character->GetNetConnection() : nullptr;
+	if (!Connection)
+	{
+		return;
+	}
+
+	if (!Connections.Contains(Connection))
+	{
+		// New connections are rare, drop the closed ones so the totals don't grow for the whole session
+		PruneConnections();
+	}
+
+	FConnectionBits& ConnectionBits = Connections.FindOrAdd(Connection);
+	if (ConnectionBits.Description.IsEmpty())
+	{
+		ConnectionBits.Description = FString::Printf(TEXT("%s (%s)"), *Connection->GetName(), *Connection->LowLevelGetRemoteAddress(true));
+	}
+
+	int64* Totals = Ar.IsSaving() ? ConnectionBits.Sent : ConnectionBits.Received;
+	Totals[static_cast<uint8>(Channel)] += Bits;
+}
+
+#endif
@@ -0,0 +1,198 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementCorrections.h"
+
+#if PREDICTED_MOVEMENT_CORRECTION_STATS
+
+#include "Engine/NetConnection.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "ProfilingDebugging/Histogram.h"
+#include "System/PredictedMovementStats.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Position Corrections"), STAT_PredictedMovement_PositionCorrections, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Movement Mode Corrections"), STAT_PredictedMovement_MovementModeCorrections, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Base Corrections"), STAT_PredictedMovement_BaseCorrections, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stamina Corrections"), STAT_PredictedMovement_StaminaCorrections, STATGROUP_PredictedMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Replayed Moves"), STAT_PredictedMovement_ReplayedMoves, STATGROUP_PredictedMovement);
+
+CSV_DEFINE_CATEGORY(PredictedMovementCorrections, true);
+
+DEFINE_LOG_CATEGORY_STATIC(LogPredictedMovementCorrections, Log, All);
+
+namespace PredictedMovementCorrections
+{
+	struct FHistograms
+	{
+		FHistograms()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			for (int64& Count : Causes)
+			{
+				Count = 0;
+			}
+			PositionError.InitLinear(0.0, 200.0, 10.0);
+			StaminaError.InitLinear(0.0, 50.0, 2.5);
+			CorrectionRTT.InitLinear(0.0, 500.0, 25.0);
+			ReplayedMoves.InitLinear(0.0, 64.0, 4.0);
+			ReplayTime.InitLinear(0.0, 5.0, 0.25);
+		}
+
+		int64 Causes[static_cast<uint8>(EPredictedMovementCorrectionCause::MAX)];
+		FHistogram PositionError;		// cm, for every cause found by UCharacterMovementComponent::ServerCheckClientError()
+		FHistogram StaminaError;		// Stamina units
+		FHistogram CorrectionRTT;		// ms
+		FHistogram ReplayedMoves;
+		FHistogram ReplayTime;			// ms
+	};
+
+	static FHistograms& GetHistograms()
+	{
+		static FHistograms Histograms;
+		return Histograms;
+	}
+
+	static void DumpHistograms(const TArray<FString>& Args)
+	{
+		FHistograms& Histograms = GetHistograms();
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Histograms.Reset();
+			return;
+		}
+
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Corrections: position %lld, movement mode %lld, base %lld, stamina %lld"),
+			Histograms.Causes[static_cast<uint8>(EPredictedMovementCorrectionCause::Position)],
+			Histograms.Causes[static_cast<uint8>(EPredictedMovementCorrectionCause::MovementMode)],
+			Histograms.Causes[static_cast<uint8>(EPredictedMovementCorrectionCause::Base)],
+			Histograms.Causes[static_cast<uint8>(EPredictedMovementCorrectionCause::Stamina)]);
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Position error (cm):"));
+		Histograms.PositionError.DumpToLog(TEXT("PositionError"));
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Stamina error:"));
+		Histograms.StaminaError.DumpToLog(TEXT("StaminaError"));
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Round trip time at correction (ms):"));
+		Histograms.CorrectionRTT.DumpToLog(TEXT("CorrectionRTT"));
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Saved moves replayed per correction:"));
+		Histograms.ReplayedMoves.DumpToLog(TEXT("ReplayedMoves"));
+		UE_LOG(LogPredictedMovementCorrections, Log, TEXT("Replay time (ms):"));
+		Histograms.ReplayTime.DumpToLog(TEXT("ReplayTime"));
+	}
+
+	static FAutoConsoleCommand CorrectionsCommand(
+		TEXT("p.PredictedMovement.Corrections"),
+		TEXT("Log histograms of correction causes, error magnitudes, round trip times and client replay cost. Pass 'reset' to clear them."),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&DumpHistograms));
+}
+
+void PredictedMovementCorrections::RecordCorrection(const UCharacterMovementComponent& Movement,
+	EPredictedMovementCorrectionCause Cause, float Error)
+{
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	const UNetConnection* Connection = Character ? Character->GetNetConnection() : nullptr;
+	const float RTT = Connection ? Connection->AvgLag * 1000.f : 0.f;
+
+	FHistograms& Histograms = GetHistograms();
+	if (Cause < EPredictedMovementCorrectionCause::MAX)
+	{
+		++Histograms.Causes[static_cast<uint8>(Cause)];
+	}
+	Histograms.CorrectionRTT.AddMeasurement(RTT);
+	CSV_CUSTOM_STAT(PredictedMovementCorrections, CorrectionRTT, RTT, ECsvCustomStatOp::Max);
+
+	switch (Cause)
+	{
+	case EPredictedMovementCorrectionCause::Position:
+		INC_DWORD_STAT(STAT_PredictedMovement_PositionCorrections);
+		Histograms.PositionError.AddMeasurement(Error);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, PositionCorrections, 1, ECsvCustomStatOp::Accumulate);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, PositionError, Error, ECsvCustomStatOp::Max);
+		break;
+	case EPredictedMovementCorrectionCause::MovementMode:
+		INC_DWORD_STAT(STAT_PredictedMovement_MovementModeCorrections);
+		Histograms.PositionError.AddMeasurement(Error);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, MovementModeCorrections, 1, ECsvCustomStatOp::Accumulate);
+		break;
+	case EPredictedMovementCorrectionCause::Base:
+		INC_DWORD_STAT(STAT_PredictedMovement_BaseCorrections);
+		Histograms.PositionError.AddMeasurement(Error);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, BaseCorrections, 1, ECsvCustomStatOp::Accumulate);
+		break;
+	case EPredictedMovementCorrectionCause::Stamina:
+		INC_DWORD_STAT(STAT_PredictedMovement_StaminaCorrections);
+		Histograms.StaminaError.AddMeasurement(Error);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, StaminaCorrections, 1, ECsvCustomStatOp::Accumulate);
+		CSV_CUSTOM_STAT(PredictedMovementCorrections, StaminaError, Error, ECsvCustomStatOp::Max);
+		break;
+	default:
+		break;
+	}
+}
+
+void PredictedMovementCorrections::RecordClientError(const UCharacterMovementComponent& Movement,
+	const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+	const UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	const ACharacter* Character = Movement.GetCharacterOwner();
+	if (!Character || !Movement.UpdatedComponent)
+	{
+		return;
+	}
+
+	// ClientWorldLocation was rebuilt from RelativeClientLocation with the base's current transform, compare in its space
+	const FVector ServerLocation = Movement.UpdatedComponent->GetComponentLocation();
+	float Error = (ServerLocation - ClientWorldLocation).Size();
+	if (MovementBaseUtility::UseRelativeLocation(ClientMovementBase))
+	{
+		FVector ServerRelativeLocation;
+		if (MovementBaseUtility::TransformLocationToLocal(ClientMovementBase, ClientBaseBoneName, ServerLocation, ServerRelativeLocation))
+		{
+			Error = (ServerRelativeLocation - RelativeClientLocation).Size();
+		}
+	}
+
+	// The engine checks the movement mode first
+	EPredictedMovementCorrectionCause Cause = EPredictedMovementCorrectionCause::Position;
+	if (Movement.PackNetworkMovementMode() != ClientMovementMode)
+	{
+		Cause = EPredictedMovementCorrectionCause::MovementMode;
+	}
+	else if (Movement.GetMovementBase() != ClientMovementBase ||
+		(ClientMovementBase && Character->GetBasedMovement().BoneName != ClientBaseBoneName))
+	{
+		Cause = EPredictedMovementCorrectionCause::Base;
+	}
+
+	RecordCorrection(Movement, Cause, Error);
+}
+
+PredictedMovementCorrections::FReplayScope::FReplayScope(const UCharacterMovementComponent& Movement)
+	: NumMoves(Movement.HasPredictionData_Client() ? Movement.GetPredictionData_Client_Character()->SavedMoves.Num() : 0)
+	, StartTime(FPlatformTime::Seconds())
+{}
+
+PredictedMovementCorrections::FReplayScope::~FReplayScope()
+{
+	if (NumMoves == 0)
+	{
+		return;
+	}
+
+	const double ReplayTime = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	FHistograms& Histograms = GetHistograms();
+	Histograms.ReplayedMoves.AddMeasurement(NumMoves);
+	Histograms.ReplayTime.AddMeasurement(ReplayTime);
+
+	INC_DWORD_STAT_BY(STAT_PredictedMovement_ReplayedMoves, NumMoves);
+	CSV_CUSTOM_STAT(PredictedMovementCorrections, ReplayedMoves, NumMoves, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(PredictedMovementCorrections, ReplayTime, ReplayTime, ECsvCustomStatOp::Accumulate);
+}
+
+#endif
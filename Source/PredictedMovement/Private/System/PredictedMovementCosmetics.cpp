@@ -0,0 +1,26 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementCosmetics.h"
+
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+
+namespace PredictedMovementCVars
+{
+	static bool bStripServerCosmetics = false;
+	FAutoConsoleVariableRef CVarStripServerCosmetics(
+		TEXT("p.PredictedMovement.StripServerCosmetics"),
+		bStripServerCosmetics,
+		TEXT("If true, dedicated servers skip mesh offsets and Blueprint events when sprint, prone or strafe change."),
+		ECVF_Default);
+}
+
+bool PredictedMovement::ShouldSkipCosmetics(const AActor* Actor)
+{
+#if UE_SERVER && PREDICTED_MOVEMENT_STRIP_SERVER_COSMETICS
+	return true;
+#else
+	return PredictedMovementCVars::bStripServerCosmetics && Actor && Actor->GetNetMode() == NM_DedicatedServer;
+#endif
+}
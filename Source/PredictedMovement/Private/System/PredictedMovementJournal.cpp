@@ -0,0 +1,249 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementJournal.h"
+
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Engine/NetDriver.h"
+#include "Engine/PackageMapClient.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Tasks/Pipe.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogPredictedMovementJournal, Log, All);
+
+namespace PredictedMovementJournal
+{
+	/** Entries held before a buffer is handed off to be written */
+	static constexpr int32 BufferSize = 256;
+
+	static const TCHAR* Header = TEXT("Reset,Timestamp,MaxSpeed,MaxAcceleration,Crouched,Sprinting,Proned,ProneLocked,")
+		TEXT("ProneLockTimestamp,Strafing,StaminaDrained,Stamina,MaxStamina");
+
+	/** Writes are serialized so that buffers are appended to each file in the order they were recorded */
+	static UE::Tasks::FPipe WritePipe { TEXT("PredictedMovementJournal") };
+
+	static bool bEnabled = false;
+	FAutoConsoleVariableRef CVarJournal(
+		TEXT("p.PredictedMovement.Journal"),
+		bEnabled,
+		TEXT("If true, record predicted movement state after every move to Saved/PredictedMovement, on clients and the server."),
+		ECVF_Default);
+
+	static bool bDiffVerbose = false;
+	FAutoConsoleVariableRef CVarJournalDiffVerbose(
+		TEXT("p.PredictedMovement.JournalDiffVerbose"),
+		bDiffVerbose,
+		TEXT("If true, p.PredictedMovement.JournalDiff logs every field that differs for every move instead of the first field for each correction."),
+		ECVF_Default);
+
+	static FAutoConsoleCommand JournalDiffCommand(
+		TEXT("p.PredictedMovement.JournalDiff"),
+		TEXT("Compare two journal files recorded with p.PredictedMovement.Journal and log the first field that differs for each correction. Usage: p.PredictedMovement.JournalDiff <ClientFile> <ServerFile>"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (Args.Num() < 2)
+			{
+				UE_LOG(LogPredictedMovementJournal, Warning, TEXT("Usage: p.PredictedMovement.JournalDiff <ClientFile> <ServerFile>"));
+				return;
+			}
+
+			TArray<FString> Differences;
+			if (!FPredictedMovementJournal::Diff(Args[0], Args[1], Differences, bDiffVerbose))
+			{
+				UE_LOG(LogPredictedMovementJournal, Warning, TEXT("Failed to load %s or %s"), *Args[0], *Args[1]);
+				return;
+			}
+
+			for (const FString& Difference : Differences)
+			{
+				UE_LOG(LogPredictedMovementJournal, Warning, TEXT("%s"), *Difference);
+			}
+			UE_LOG(LogPredictedMovementJournal, Log, TEXT("%d differences between %s and %s"), Differences.Num(), *Args[0], *Args[1]);
+		}));
+
+	/** @return The client timestamp of the move being performed, or a negative value if it should not be recorded */
+	static float GetMoveTimestamp(const UCharacterMovementComponent* Movement)
+	{
+		const ACharacter* Character = Movement->GetCharacterOwner();
+		if (Character->GetLocalRole() == ROLE_AutonomousProxy)
+		{
+			// Replayed moves were already recorded when they were first performed
+			if (Movement->bClientUpdating || !Movement->HasPredictionData_Client())
+			{
+				return -1.f;
+			}
+			return Movement->GetPredictionData_Client_Character()->CurrentTimeStamp;
+		}
+
+		if (Character->GetLocalRole() == ROLE_Authority)
+		{
+			if (Character->GetRemoteRole() == ROLE_AutonomousProxy)
+			{
+				return Movement->HasPredictionData_Server() ?
+					Movement->GetPredictionData_Server_Character()->CurrentClientTimeStamp : -1.f;
+			}
+			return Movement->GetWorld()->GetTimeSeconds();
+		}
+
+		return -1.f;
+	}
+
+	/** @return The NetGUID of Actor, which is the same on the client and the server, or its name if it has none */
+	static FString GetNetIdentity(const AActor* Actor)
+	{
+		const UNetDriver* NetDriver = Actor ? Actor->GetNetDriver() : nullptr;
+		if (NetDriver && NetDriver->GuidCache.IsValid())
+		{
+			const FNetworkGUID NetGUID = NetDriver->GuidCache->GetNetGUID(Actor);
+			if (NetGUID.IsValid())
+			{
+				return NetGUID.ToString();
+			}
+		}
+		return GetNameSafe(Actor);
+	}
+
+	/** @return The reset count and timestamp of a journal line, which identify the move */
+	static FString GetMoveKey(const TArray<FString>& Values)
+	{
+		return Values.Num() >= 2 ? Values[0] + TEXT(",") + Values[1] : FString();
+	}
+
+	static void AppendEntry(FString& Out, const FPredictedMovementJournalEntry& Entry)
+	{
+		const FPredictedMovementSnapshot& State = Entry.State;
+		Out.Appendf(TEXT("%d,%.6f,%.3f,%.3f,%d,%d,%d,%d,%.6f,%d,%d,%.3f,%.3f\n"),
+			Entry.ResetCount, Entry.Timestamp, Entry.MaxSpeed, Entry.MaxAcceleration,
+			State.bIsCrouched, State.bIsSprinting, State.bIsProned, State.bIsProneLocked, State.ProneLockTimestamp,
+			State.bIsStrafing, State.bIsStaminaDrained, State.Stamina, State.MaxStamina);
+	}
+}
+
+bool FPredictedMovementJournal::IsEnabled()
+{
+	return PredictedMovementJournal::bEnabled;
+}
+
+void FPredictedMovementJournal::Record(const UCharacterMovementComponent* Movement, const FPredictedMovementSnapshot& State)
+{
+	const float Timestamp = PredictedMovementJournal::GetMoveTimestamp(Movement);
+	if (Timestamp < 0.f)
+	{
+		return;
+	}
+
+	if (FilePath.IsEmpty())
+	{
+		const TCHAR* NetModeName = Movement->GetNetMode() == NM_Client ? TEXT("Client") : TEXT("Server");
+		FilePath = FPaths::ProjectSavedDir() / TEXT("PredictedMovement") / FString::Printf(TEXT("%s_%s_%s.csv"),
+			*GetNameSafe(Movement->GetOwner()->GetClass()), *PredictedMovementJournal::GetNetIdentity(Movement->GetOwner()), NetModeName);
+
+		// Start a new file for each play session
+		const FString Path = FilePath;
+		PredictedMovementJournal::WritePipe.Launch(UE_SOURCE_LOCATION, [Path]()
+		{
+			FFileHelper::SaveStringToFile(FString(PredictedMovementJournal::Header) + TEXT("\n"), *Path);
+		});
+
+		Entries.Reserve(PredictedMovementJournal::BufferSize);
+	}
+
+	// The client timestamp wraps back to 0 periodically, and the server follows it on the same move
+	if (Timestamp < LastTimestamp)
+	{
+		++ResetCount;
+	}
+	LastTimestamp = Timestamp;
+
+	FPredictedMovementJournalEntry& Entry = Entries.AddDefaulted_GetRef();
+	Entry.ResetCount = ResetCount;
+	Entry.Timestamp = Timestamp;
+	Entry.MaxSpeed = Movement->GetMaxSpeed();
+	Entry.MaxAcceleration = Movement->GetMaxAcceleration();
+	Entry.State = State;
+
+	if (Entries.Num() >= PredictedMovementJournal::BufferSize)
+	{
+		Flush();
+	}
+}
+
+void FPredictedMovementJournal::Flush()
+{
+	if (Entries.Num() == 0)
+	{
+		return;
+	}
+
+	PredictedMovementJournal::WritePipe.Launch(UE_SOURCE_LOCATION, [Path = FilePath, Buffer = MoveTemp(Entries)]()
+	{
+		FString Text;
+		for (const FPredictedMovementJournalEntry& Entry : Buffer)
+		{
+			PredictedMovementJournal::AppendEntry(Text, Entry);
+		}
+		FFileHelper::SaveStringToFile(Text, *Path, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(),
+			FILEWRITE_Append);
+	});
+
+	Entries.Reset(PredictedMovementJournal::BufferSize);
+}
+
+bool FPredictedMovementJournal::Diff(const FString& ClientFile, const FString& ServerFile, TArray<FString>& OutDifferences, bool bAllFields)
+{
+	TArray<FString> ClientLines;
+	TArray<FString> ServerLines;
+	if (!FFileHelper::LoadFileToStringArray(ClientLines, *ClientFile) || !FFileHelper::LoadFileToStringArray(ServerLines, *ServerFile))
+	{
+		return false;
+	}
+	if (ClientLines.Num() == 0 || ServerLines.Num() == 0)
+	{
+		return true;
+	}
+
+	TArray<FString> Fields;
+	ClientLines[0].ParseIntoArray(Fields, TEXT(","));
+
+	// Index the server moves by reset count and timestamp, the server may have dropped or combined moves the client sent
+	TArray<FString> ServerValues;
+	TMap<FString, int32> ServerMoves;
+	for (int32 Index = 1; Index < ServerLines.Num(); ++Index)
+	{
+		ServerLines[Index].ParseIntoArray(ServerValues, TEXT(","));
+		ServerMoves.Add(PredictedMovementJournal::GetMoveKey(ServerValues), Index);
+	}
+
+	TArray<FString> ClientValues;
+	bool bDiverged = false;
+	for (int32 Index = 1; Index < ClientLines.Num(); ++Index)
+	{
+		ClientLines[Index].ParseIntoArray(ClientValues, TEXT(","));
+		const int32* ServerIndex = ClientValues.Num() >= 2 ? ServerMoves.Find(PredictedMovementJournal::GetMoveKey(ClientValues)) : nullptr;
+		if (!ServerIndex)
+		{
+			continue;
+		}
+
+		ServerLines[*ServerIndex].ParseIntoArray(ServerValues, TEXT(","));
+		bool bDiffers = false;
+		for (int32 Field = 2; Field < FMath::Min3(Fields.Num(), ClientValues.Num(), ServerValues.Num()); ++Field)
+		{
+			if (ClientValues[Field] != ServerValues[Field])
+			{
+				// Later fields and moves in the same correction usually differ only because of this one
+				if (bAllFields || (!bDiverged && !bDiffers))
+				{
+					OutDifferences.Add(FString::Printf(TEXT("Move %s after %s resets (client line %d, server line %d): %s is %s on the client and %s on the server"),
+						*ClientValues[1], *ClientValues[0], Index + 1, *ServerIndex + 1, *Fields[Field], *ClientValues[Field], *ServerValues[Field]));
+				}
+				bDiffers = true;
+			}
+		}
+		bDiverged = bDiffers;
+	}
+	return true;
+}
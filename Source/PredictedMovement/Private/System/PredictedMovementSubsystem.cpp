@@ -0,0 +1,245 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementSubsystem.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "System/PredictedMovementTrace.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(PredictedMovementSubsystem)
+
+void FPredictedMovementRegistration::Register(const UCharacterMovementComponent* Movement)
+{
+	Unregister();
+
+	ACharacter* Character = Movement ? Movement->GetCharacterOwner() : nullptr;
+	UPredictedMovementSubsystem* NewSubsystem = Character ? UWorld::GetSubsystem<UPredictedMovementSubsystem>(Character->GetWorld()) : nullptr;
+	if (NewSubsystem)
+	{
+		Subsystem = NewSubsystem;
+		Slot = NewSubsystem->Register(Character);
+	}
+}
+
+void FPredictedMovementRegistration::Unregister()
+{
+	if (UPredictedMovementSubsystem* CurrentSubsystem = Subsystem.Get())
+	{
+		CurrentSubsystem->Unregister(Slot);
+	}
+	Subsystem.Reset();
+	Slot = INDEX_NONE;
+}
+
+void FPredictedMovementRegistration::SetState(EPredictedMovementState State, bool bEnabled) const
+{
+	if (UPredictedMovementSubsystem* CurrentSubsystem = Subsystem.Get())
+	{
+		CurrentSubsystem->SetState(Slot, State, bEnabled);
+	}
+}
+
+void FPredictedMovementRegistration::SetStamina(float NewStamina) const
+{
+	if (UPredictedMovementSubsystem* CurrentSubsystem = Subsystem.Get())
+	{
+		CurrentSubsystem->SetStamina(Slot, NewStamina);
+	}
+}
+
+void UPredictedMovementSubsystem::Deinitialize()
+{
+	Characters.Reset();
+	StateBits.Reset();
+	Stamina.Reset();
+	for (TArray<int32>& Members : StateMembers)
+	{
+		Members.Reset();
+	}
+	FreeSlots.Reset();
+	SlotsByCharacter.Reset();
+
+	Super::Deinitialize();
+}
+
+bool UPredictedMovementSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+int32 UPredictedMovementSubsystem::Register(ACharacter* Character)
+{
+	if (!IsValid(Character))
+	{
+		return INDEX_NONE;
+	}
+
+	if (const int32* ExistingSlot = SlotsByCharacter.Find(Character))
+	{
+		return *ExistingSlot;
+	}
+
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop();
+		Characters[Slot] = Character;
+		StateBits[Slot] = 0;
+		Stamina[Slot] = 0.f;
+	}
+	else
+	{
+		Slot = Characters.Add(Character);
+		StateBits.Add(0);
+		Stamina.Add(0.f);
+	}
+	SlotsByCharacter.Add(Character, Slot);
+	return Slot;
+}
+
+void UPredictedMovementSubsystem::Unregister(int32 Slot)
+{
+	if (!Characters.IsValidIndex(Slot))
+	{
+		return;
+	}
+
+	for (uint8 State = 0; State < static_cast<uint8>(EPredictedMovementState::MAX); ++State)
+	{
+		SetState(Slot, static_cast<EPredictedMovementState>(State), false);
+	}
+
+	if (const ACharacter* Character = Characters[Slot].Get())
+	{
+		SlotsByCharacter.Remove(Character);
+	}
+	else
+	{
+		// Already destroyed, find it by slot instead
+		for (auto It = SlotsByCharacter.CreateIterator(); It; ++It)
+		{
+			if (It.Value() == Slot)
+			{
+				It.RemoveCurrent();
+				break;
+			}
+		}
+	}
+	Characters[Slot].Reset();
+	FreeSlots.Add(Slot);
+}
+
+void UPredictedMovementSubsystem::SetState(int32 Slot, EPredictedMovementState State, bool bEnabled)
+{
+	if (!StateBits.IsValidIndex(Slot) || State >= EPredictedMovementState::MAX)
+	{
+		return;
+	}
+
+	const uint8 Bit = 1 << static_cast<uint8>(State);
+	if (((StateBits[Slot] & Bit) != 0) == bEnabled)
+	{
+		return;
+	}
+
+	TArray<int32>& Members = StateMembers[static_cast<uint8>(State)];
+	if (bEnabled)
+	{
+		StateBits[Slot] |= Bit;
+		Members.Add(Slot);
+	}
+	else
+	{
+		StateBits[Slot] &= ~Bit;
+		Members.RemoveSingleSwap(Slot);
+	}
+
+	PREDICTED_MOVEMENT_TRACE_STATE_CHANGE(Characters[Slot].Get(), State, bEnabled);
+}
+
+void UPredictedMovementSubsystem::SetStamina(int32 Slot, float NewStamina)
+{
+	if (Stamina.IsValidIndex(Slot))
+	{
+		Stamina[Slot] = NewStamina;
+	}
+}
+
+int32 UPredictedMovementSubsystem::GetNumInState(EPredictedMovementState State) const
+{
+	return State < EPredictedMovementState::MAX ? StateMembers[static_cast<uint8>(State)].Num() : 0;
+}
+
+void UPredictedMovementSubsystem::GetCharactersInState(EPredictedMovementState State,
+	TArray<ACharacter*>& OutCharacters) const
+{
+	if (State < EPredictedMovementState::MAX)
+	{
+		ForEachInState(State, [&OutCharacters](ACharacter* Character)
+		{
+			OutCharacters.Add(Character);
+			return true;
+		});
+	}
+}
+
+void UPredictedMovementSubsystem::GetCharactersInStateInRadius(EPredictedMovementState State, const FVector& Origin,
+	float Radius, TArray<ACharacter*>& OutCharacters) const
+{
+	if (State < EPredictedMovementState::MAX)
+	{
+		const double RadiusSquared = FMath::Square(Radius);
+		ForEachInState(State, [&](ACharacter* Character)
+		{
+			if (FVector::DistSquared(Character->GetActorLocation(), Origin) <= RadiusSquared)
+			{
+				OutCharacters.Add(Character);
+			}
+			return true;
+		});
+	}
+}
+
+void UPredictedMovementSubsystem::GetCharactersInStateInBox(EPredictedMovementState State, const FBox& Box,
+	TArray<ACharacter*>& OutCharacters) const
+{
+	if (State < EPredictedMovementState::MAX)
+	{
+		ForEachInState(State, [&](ACharacter* Character)
+		{
+			if (Box.IsInsideOrOn(Character->GetActorLocation()))
+			{
+				OutCharacters.Add(Character);
+			}
+			return true;
+		});
+	}
+}
+
+bool UPredictedMovementSubsystem::GetStamina(const ACharacter* Character, float& OutStamina) const
+{
+	if (const int32* Slot = SlotsByCharacter.Find(Character))
+	{
+		OutStamina = Stamina[*Slot];
+		return true;
+	}
+	return false;
+}
+
+bool UPredictedMovementSubsystem::ConsumeProxyCosmeticsBudget(int32 PerFrame)
+{
+	if (ProxyCosmeticsBudgetFrame != GFrameCounter)
+	{
+		ProxyCosmeticsBudgetFrame = GFrameCounter;
+		ProxyCosmeticsBudgetUsed = 0;
+	}
+
+	if (ProxyCosmeticsBudgetUsed >= PerFrame)
+	{
+		return false;
+	}
+	++ProxyCosmeticsBudgetUsed;
+	return true;
+}
@@ -0,0 +1,39 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+
+#include "System/PredictedMovementTrace.h"
+
+#if PREDICTED_MOVEMENT_TRACE_ENABLED
+
+#include "GameFramework/Character.h"
+#include "System/PredictedMovementSubsystem.h"
+
+UE_TRACE_CHANNEL_DEFINE(PredictedMovementChannel);
+
+UE_TRACE_EVENT_BEGIN(PredictedMovement, StateChange)
+	UE_TRACE_EVENT_FIELD(uint64, Cycle)
+	UE_TRACE_EVENT_FIELD(uint32, ActorId)
+	UE_TRACE_EVENT_FIELD(uint8, State)
+	UE_TRACE_EVENT_FIELD(bool, bEnabled)
+	UE_TRACE_EVENT_FIELD(uint8, Role)
+	UE_TRACE_EVENT_FIELD(UE::Trace::WideString, ActorName)
+UE_TRACE_EVENT_END()
+
+void PredictedMovementTrace::TraceStateChange(const ACharacter* Character, EPredictedMovementState State, bool bEnabled)
+{
+	if (!Character || !UE_TRACE_CHANNELEXPR_IS_ENABLED(PredictedMovementChannel))
+	{
+		return;
+	}
+
+	const FString ActorName = Character->GetName();
+	UE_TRACE_LOG(PredictedMovement, StateChange, PredictedMovementChannel)
+		<< StateChange.Cycle(FPlatformTime::Cycles64())
+		<< StateChange.ActorId(Character->GetUniqueID())
+		<< StateChange.State(static_cast<uint8>(State))
+		<< StateChange.bEnabled(bEnabled)
+		<< StateChange.Role(static_cast<uint8>(Character->GetLocalRole()))
+		<< StateChange.ActorName(*ActorName, ActorName.Len());
+}
+
+#endif
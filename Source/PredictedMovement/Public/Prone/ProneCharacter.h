@@ -7,6 +7,26 @@
 #include "ProneCharacter.generated.h"
 
 class UProneMovement;
+
+/** Bits of AProneCharacter::ReplicatedStanceState */
+namespace EProneStanceState
+{
+	enum Type : uint8
+	{
+		None		= 0,
+		Crouched	= 1 << 0,
+		Proned		= 1 << 1,
+	};
+}
+
+/** Cosmetic part of a prone transition that is waiting to be applied to a simulated proxy */
+enum class EProneProxyCosmetics : uint8
+{
+	None,
+	StartProne,
+	EndProne,
+};
+
 UCLASS()
 class PREDICTEDMOVEMENT_API AProneCharacter : public ACharacter
 {
@@ -28,8 +48,27 @@ public:
 	
 public:
 	/** Set by character movement to specify that this Character is currently Proned. */
-	UPROPERTY(BlueprintReadOnly, replicatedUsing=OnRep_IsProned, Category=Character)
+	UPROPERTY(BlueprintReadOnly, Category=Character)
 	uint32 bIsProned:1;
+
+protected:
+	/**
+	 * bIsCrouched and bIsProned packed into EProneStanceState bits, replicated in place of bIsCrouched so that
+	 * simulated proxies receive both in the same update and apply them in a fixed order.
+	 * @see OnRep_StanceState
+	 */
+	UPROPERTY(ReplicatedUsing=OnRep_StanceState)
+	uint8 ReplicatedStanceState;
+
+	/** Deferred eye height, mesh offset and Blueprint event for a simulated proxy, @see ShouldDeferProxyCosmetics */
+	EProneProxyCosmetics PendingProxyCosmetics;
+	float PendingHalfHeightAdjust;
+	float PendingScaledHalfHeightAdjust;
+	/** bIsCrouched when the transition was deferred, OnEndProne only restores the mesh offset when standing */
+	bool bPendingIsCrouched;
+	/** Mesh smoothing offset added by UProneMovement, applied together with the deferred mesh offset */
+	float PendingMeshTranslationOffset;
+	bool bApplyingPendingProxyCosmetics;
 	
 public:
 	AProneCharacter(const FObjectInitializer& FObjectInitializer);
@@ -37,12 +76,64 @@ public:
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
 public:
+	virtual void OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust) override;
+	virtual void OnEndCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust) override;
 	virtual void RecalculateBaseEyeHeight() override;
 
-	/** Handle Crouching replicated from server */
+	/** @return bIsCrouched and bIsProned as EProneStanceState bits */
+	uint8 GetStanceState() const;
+
+	/**
+	 * Pack the current stance into ReplicatedStanceState on the server and mark it dirty if it changed.
+	 * Called by UProneMovement wherever bIsCrouched or bIsProned change.
+	 */
+	void MarkStanceStateDirty();
+
+	/**
+	 * Handle stance replicated from server.
+	 * Leaving prone and crouch is applied before entering crouch and prone, so a single update that changes both
+	 * always produces the same transitions.
+	 */
 	UFUNCTION()
-	virtual void OnRep_IsProned();
+	virtual void OnRep_StanceState(uint8 PreviousStanceState);
 
+	/** Called by OnRep_StanceState after the transitions are applied, with the EProneStanceState bits that changed */
+	virtual void OnStanceStateReplicated(uint8 PreviousStanceState, uint8 ChangedStanceState) {}
+
+	/**
+	 * Simulated proxies always resize their capsule immediately when prone changes, but the cosmetic part of
+	 * OnStartProne and OnEndProne can wait until the proxy is significant again, and is otherwise applied within a
+	 * per-frame budget (p.Prone.ProxyCosmeticsPerFrame).
+	 * By default, proxies that have not been rendered recently are deferred. Override to use your own significance.
+	 */
+	virtual bool ShouldDeferProxyCosmetics() const;
+
+	/**
+	 * Apply deferred cosmetics once the proxy is significant again, or within the per-frame budget.
+	 * Called by UProneMovement every tick, so it doesn't depend on the actor ticking.
+	 */
+	void UpdatePendingProxyCosmetics();
+
+	/**
+	 * Add DeltaZ to the movement component's mesh translation offset so the capsule resize isn't smoothed. Waits for the
+	 * deferred cosmetics of the same transition, the mesh would pop while only one of the two offsets is applied.
+	 */
+	void AddProxyMeshTranslationOffset(float DeltaZ);
+
+protected:
+	/** @return True if another deferred transition can be applied this frame, the budget is per world */
+	bool ConsumeProxyCosmeticsBudget() const;
+
+	/**
+	 * Defers the transition, or cancels a pending opposite transition.
+	 * @return True if the cosmetic part of the transition was deferred or cancelled and should not be applied now
+	 */
+	bool DeferProxyCosmetics(EProneProxyCosmetics Transition, float HalfHeightAdjust, float ScaledHalfHeightAdjust);
+
+	void ApplyPendingProxyCosmetics();
+	void ApplyPendingMeshTranslationOffset();
+
+public:
 	/**
 	 * Request the character to start Proned. The request is processed on the next update of the CharacterMovementComponent.
 	 * @see OnStartProne
@@ -65,14 +156,14 @@ public:
 	UFUNCTION(BlueprintCallable, Category=Character)
 	virtual bool CanProne() const;
 	
-	/** Called when Character stops Proned. Called on non-owned Characters through bIsProned replication. */
+	/** Called when Character stops Proned. Called on non-owned Characters through ReplicatedStanceState replication. */
 	virtual void OnEndProne(float HalfHeightAdjust, float ScaledHalfHeightAdjust);
 
 	/** Event when Character stops Proned. */
 	UFUNCTION(BlueprintImplementableEvent, meta=(DisplayName="OnEndProne", ScriptName="OnEndProne"))
 	void K2_OnEndProne(float HalfHeightAdjust, float ScaledHalfHeightAdjust);
 
-	/** Called when Character Pronees. Called on non-owned Characters through bIsProned replication. */
+	/** Called when Character Pronees. Called on non-owned Characters through ReplicatedStanceState replication. */
 	virtual void OnStartProne(float HalfHeightAdjust, float ScaledHalfHeightAdjust);
 
 	/** Event when Character Pronees. */
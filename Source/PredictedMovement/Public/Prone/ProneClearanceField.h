@@ -0,0 +1,128 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Prone/ProneMovement.h"
+#include "ProneClearanceField.generated.h"
+
+class AProneCharacter;
+class UBoxComponent;
+
+/** Flags stored for each cell of an AProneClearanceField */
+namespace EProneClearanceCell
+{
+	enum Type : uint8
+	{
+		None				= 0,
+		HasFloor			= 1 << 0,
+		StandFits			= 1 << 1,
+		CrouchFits			= 1 << 2,
+		ProneFits			= 1 << 3,
+		StandBlockedInCell	= 1 << 4,		// Standing is blocked everywhere within the cell, near its floor height
+		CrouchBlockedInCell	= 1 << 5,		// Crouching is blocked everywhere within the cell, near its floor height
+	};
+}
+
+/**
+ * Grid of baked stance clearance over the walkable floor within its bounds.
+ * Each cell stores the floor height and which stance capsules fit there, using the default capsule and
+ * PronedRadius / PronedHalfHeight of CharacterClass.
+ *
+ * Only static geometry is baked, and only the topmost walkable floor of each cell. The data is saved with the level
+ * and streams in and out with it. Lookups are O(1).
+ *
+ * UProneMovement uses the field as an early-out: when a cell reports that a stance is blocked everywhere within it,
+ * the overlap tests for leaving prone are skipped. The blocked flags are conservative, they are only set when the full
+ * stance capsule is blocked at every location in the cell with its base within HeightTolerance of the baked floor. Client and server load the same data, so both reach the same result.
+ * The baked capsule dimensions are stored with the data, and the field only answers for a character whose stance
+ * capsule matches them. Other classes, scaled capsules and capsules resized at runtime always run the overlap tests.
+ * Re-bake after changing geometry or capsule dimensions.
+ */
+UCLASS(Blueprintable)
+class PREDICTEDMOVEMENT_API AProneClearanceField : public AActor
+{
+	GENERATED_BODY()
+
+private:
+	/** Area covered by the field */
+	UPROPERTY(Category=Clearance, VisibleAnywhere, BlueprintReadOnly, meta=(AllowPrivateAccess = "true"))
+	TObjectPtr<UBoxComponent> Bounds;
+
+public:
+	/** Capsule dimensions are taken from this class and its UProneMovement */
+	UPROPERTY(Category=Clearance, EditAnywhere, BlueprintReadOnly)
+	TSubclassOf<AProneCharacter> CharacterClass;
+
+	/**
+	 * Size of each cell, smaller cells are more accurate but use more memory.
+	 * Half the cell diagonal must be well below the capsule radius, otherwise no cell can report a stance as blocked.
+	 */
+	UPROPERTY(Category=Clearance, EditAnywhere, BlueprintReadOnly, meta=(ClampMin="10", UIMin="10", ForceUnits=cm))
+	float CellSize;
+
+	/**
+	 * How far the base of the capsule may be from the baked floor height for the cell to be used.
+	 * Larger values cover more uneven floors, but fewer cells can report a stance as blocked.
+	 */
+	UPROPERTY(Category=Clearance, EditAnywhere, BlueprintReadOnly, meta=(ClampMin="0", UIMin="0", ForceUnits=cm))
+	float HeightTolerance;
+
+	/** If true, bake when play begins instead of using data baked in the editor */
+	UPROPERTY(Category=Clearance, EditAnywhere, BlueprintReadOnly)
+	bool bBakeOnBeginPlay;
+
+protected:
+	/** Minimum corner of the baked grid, in world space */
+	UPROPERTY()
+	FVector GridOrigin;
+
+	UPROPERTY()
+	FIntPoint GridSize;
+
+	/** EProneClearanceCell flags for each cell */
+	UPROPERTY()
+	TArray<uint8> Cells;
+
+	/** Floor height of each cell, relative to GridOrigin */
+	UPROPERTY()
+	TArray<int16> FloorHeights;
+
+	/** Scaled capsule dimensions of CharacterClass when the field was baked */
+	UPROPERTY()
+	float BakedRadius;
+
+	UPROPERTY()
+	float BakedStandHalfHeight;
+
+	UPROPERTY()
+	float BakedCrouchHalfHeight;
+
+public:
+	AProneClearanceField(const FObjectInitializer& ObjectInitializer);
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	/** Sample the floor within Bounds and store which stances fit in each cell */
+	UFUNCTION(CallInEditor, BlueprintCallable, Category=Clearance)
+	void Bake();
+
+	/** @return True if there is baked data at BaseLocation (the base of the capsule) */
+	bool GetCellFlags(const FVector& BaseLocation, uint8& OutFlags) const;
+
+	/**
+	 * @return True if there is baked floor at Location
+	 * @param	OutStance	The tallest stance that fits at the center of the cell
+	 */
+	UFUNCTION(BlueprintCallable, Category=Clearance)
+	bool GetTallestStanceAtLocation(const FVector& Location, EProneStance& OutStance) const;
+
+	/**
+	 * @return True if TargetStance is known to be blocked by static geometry everywhere in the cell at BaseLocation.
+	 * Always false unless ScaledCapsule, the querying character's capsule for TargetStance, matches the baked capsule.
+	 */
+	bool IsStanceBlocked(const FVector& BaseLocation, EProneStance TargetStance, const FProneStanceCapsule& ScaledCapsule) const;
+};
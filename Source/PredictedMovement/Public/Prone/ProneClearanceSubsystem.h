@@ -0,0 +1,83 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldCollision.h"
+#include "ProneClearanceSubsystem.generated.h"
+
+class AProneClearanceField;
+class UProneMovement;
+enum class EProneClearanceQuery : uint8;
+enum class EProneStance : uint8;
+struct FProneStanceCapsule;
+
+struct FProneClearanceRequest
+{
+	TWeakObjectPtr<UProneMovement> Movement;
+	EProneClearanceQuery Query;
+
+	bool operator==(const FProneClearanceRequest& Other) const
+	{
+		return Movement == Other.Movement && Query == Other.Query;
+	}
+};
+
+struct FProneClearanceInFlight
+{
+	FProneClearanceRequest Request;
+	FVector Location;
+	FCollisionShape Shape;
+	uint64 FrameStamp;
+};
+
+/**
+ * Batches clearance queries for every UProneMovement in the world into a single pass of asynchronous overlaps per
+ * frame, and writes the results back to the requesting movement components with a frame stamp.
+ * Use UProneMovement::RequestClearance() and UProneMovement::GetCachedClearance() rather than calling this directly.
+ */
+UCLASS()
+class PREDICTEDMOVEMENT_API UProneClearanceSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+public:
+	/** Queue a clearance query to be issued with the rest of this frame's requests */
+	void RequestClearance(UProneMovement* Movement, EProneClearanceQuery Query);
+
+	void RegisterField(AProneClearanceField* Field);
+	void UnregisterField(AProneClearanceField* Field);
+
+	/**
+	 * @return True if a baked AProneClearanceField reports that TargetStance is blocked around BaseLocation
+	 * @param	ScaledCapsule	The querying character's capsule for TargetStance, fields baked with another capsule are ignored
+	 */
+	bool IsStanceBlockedByField(const FVector& BaseLocation, EProneStance TargetStance, const FProneStanceCapsule& ScaledCapsule) const;
+
+protected:
+	void OnOverlapCompleted(const FTraceHandle& TraceHandle, FOverlapDatum& OverlapDatum);
+
+private:
+	/** Requests made since the last tick */
+	TArray<FProneClearanceRequest> PendingRequests;
+
+	/** Issued queries waiting for a result, keyed by the UserData passed to the async overlap */
+	TMap<uint32, FProneClearanceInFlight> InFlight;
+
+	FOverlapDelegate OverlapDelegate;
+
+	/** Baked clearance fields in the world, registered while they are playing */
+	TArray<TWeakObjectPtr<AProneClearanceField>> Fields;
+
+	uint32 NextRequestId = 0;
+};
@@ -4,9 +4,72 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "System/PredictedMovementJournal.h"
+#include "System/PredictedMovementSnapshot.h"
+#include "System/PredictedMovementSubsystem.h"
 #include "ProneMovement.generated.h"
 
 class AProneCharacter;
+
+UENUM(BlueprintType)
+enum class EProneStance : uint8
+{
+	Stand,
+	Crouch,
+	Prone,
+};
+
+/** Unscaled capsule dimensions for a stance */
+struct PREDICTEDMOVEMENT_API FProneStanceCapsule
+{
+	float Radius = 0.f;
+	float HalfHeight = 0.f;
+};
+
+UENUM(BlueprintType)
+enum class EProneClearanceQuery : uint8
+{
+	Stand		UMETA(ToolTip="Could the character leave prone at its current location"),
+	Prone		UMETA(ToolTip="Could the character fit into the proned capsule at its current location"),
+};
+
+/** Result of a clearance query, stamped with the frame the query was issued on */
+struct PREDICTEDMOVEMENT_API FProneClearanceResult
+{
+	FVector Location = FVector::ZeroVector;
+	float Radius = 0.f;
+	float HalfHeight = 0.f;
+	uint64 FrameStamp = 0;
+	bool bIsClear = false;
+	bool bValid = false;
+};
+
+/**
+ * Conditions under which UnProne last failed its clearance test.
+ * While these conditions still hold, repeating the test would fail again, so UnProne skips the physics queries until
+ * the character moves at all, changes floor or capsule size, or the retry delay elapses.
+ * The retry delay is measured in the timestamp of the move being performed (see UProneMovement::GetTimestamp), including
+ * moves the client replays, so client and server retry on the same moves.
+ * The cache is not part of the saved move, so it is cleared on both sides when a correction is sent: by the server in
+ * ServerSendMoveResponse() and by the client before it replays its saved moves.
+ */
+struct PREDICTEDMOVEMENT_API FProneUnProneBlockedCache
+{
+	FVector Location = FVector::ZeroVector;
+	TWeakObjectPtr<UPrimitiveComponent> FloorComponent = nullptr;
+	float Radius = 0.f;
+	float HalfHeight = 0.f;
+	float Timestamp = -1.f;
+	float RetryDelay = 0.f;
+	bool bValid = false;
+
+	void Invalidate()
+	{
+		bValid = false;
+		RetryDelay = 0.f;
+	}
+};
+
 UCLASS()
 class PREDICTEDMOVEMENT_API UProneMovement : public UCharacterMovementComponent
 {
@@ -17,6 +80,10 @@ private:
 	UPROPERTY(Transient, DuplicateTransient)
 	TObjectPtr<AProneCharacter> ProneCharacterOwner;
 
+protected:
+	/** Mirrors state changes to UPredictedMovementSubsystem */
+	FPredictedMovementRegistration StateRegistration;
+
 public:
 	/** Max Acceleration (rate of change of velocity) */
 	UPROPERTY(Category="Character Movement (General Settings)", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0"))
@@ -68,6 +135,27 @@ public:
 	 */
 	UPROPERTY(Category="Character Movement (General Settings)", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0", ForceUnits=cm))
 	float ProneLockDuration;
+
+	/**
+	 * When UnProne fails because the standing capsule is encroached, it is not re-tested until the character moves,
+	 * changes floor or capsule size, or this delay elapses. The delay doubles for each consecutive failure under the
+	 * same conditions, up to UnProneBlockedMaxRetryDelay, so that changes to nearby geometry are still picked up.
+	 * Set to 0 to re-test every update.
+	 */
+	UPROPERTY(Category="Character Movement (General Settings)", AdvancedDisplay, EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0", ForceUnits=s))
+	float UnProneBlockedRetryDelay;
+
+	/** Maximum delay between UnProne clearance tests while the conditions of the last failure still hold */
+	UPROPERTY(Category="Character Movement (General Settings)", AdvancedDisplay, EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0", ForceUnits=s))
+	float UnProneBlockedMaxRetryDelay;
+
+	/**
+	 * If true, an AProneClearanceField covering the character's location can report that leaving prone is blocked
+	 * without running the overlap tests. Fields only contain static geometry, so they never report a blocked stance
+	 * that would otherwise fit, and they are only used when the stance capsule matches the one they were baked with.
+	 */
+	UPROPERTY(Category="Character Movement (General Settings)", AdvancedDisplay, EditAnywhere, BlueprintReadWrite)
+	uint8 bUseProneClearanceField:1;
 	
 	/** If true, Character can walk off a ledge when proned. */
 	UPROPERTY(Category="Character Movement: Walking", EditAnywhere, BlueprintReadWrite)
@@ -84,12 +172,52 @@ public:
 protected:
 	float ProneLockTimestamp = -1.f;
 
+	/**
+	 * Conditions of the last failed UnProne clearance test, indexed by target stance (Stand or Crouch).
+	 * A blocked UnProneToStance(Crouch) is followed by UnProne() in the same update, so each target keeps its own entry.
+	 */
+	FProneUnProneBlockedCache UnProneBlockedCache[2];
+
+	/** Timestamp of the saved move being replayed by ClientUpdatePositionAfterServerUpdate(), or -1 */
+	float ReplayedMoveTimestamp;
+
+	/** Latest clearance query results, indexed by EProneClearanceQuery */
+	FProneClearanceResult ClearanceResults[2];
+
+	/** Standing capsule of the owner's default object, cached so transitions don't need to look it up */
+	FProneStanceCapsule DefaultCapsule;
+
 public:
 	UProneMovement(const FObjectInitializer& ObjectInitializer);
 	
 	virtual bool HasValidData() const override;
 	virtual void PostLoad() override;
 	virtual void SetUpdatedComponent(USceneComponent* NewUpdatedComponent) override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/** Predicted state published at the end of the last movement tick, safe to call from animation worker threads */
+	UFUNCTION(BlueprintPure, Category="Character Movement", meta=(BlueprintThreadSafe))
+	FPredictedMovementSnapshot GetStateSnapshot() const { return StateSnapshot.Read(); }
+
+protected:
+	/** Fill in the snapshot published after each movement tick */
+	virtual void FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const;
+
+	FPredictedMovementSnapshotBuffer StateSnapshot;
+
+	virtual void PerformMovement(float DeltaTime) override;
+
+	/** Records state after each move while p.PredictedMovement.Journal is enabled */
+	FPredictedMovementJournal Journal;
+
+protected:
+	void CacheDefaultCapsule();
+
+public:
+	/** @return Unscaled capsule dimensions used by Stance, the proned and crouched capsules reflect current settings */
+	FProneStanceCapsule GetStanceCapsule(EProneStance Stance) const;
 
 public:
 	virtual float GetMaxAcceleration() const override;
@@ -113,8 +241,61 @@ public:
 
 	void SetProneLock(bool bLock);
 
+	/**
+	 * Timestamp used for the prone lock and blocked UnProne retries.
+	 * Characters owned by the server, including AI, use world time. Clients and the server's copy of a remote client's
+	 * character use predicted move timestamps, and a client replaying its saved moves uses the timestamp of each one.
+	 */
 	float GetTimestamp() const;
 
+protected:
+	/** @return True if the conditions of the last failed UnProne clearance test still hold */
+	bool DoesUnProneBlockedCacheMatch(EProneStance TargetStance) const;
+
+	/** @return True if UnProne failed under the current conditions and the retry delay has not elapsed yet */
+	bool IsUnProneBlockedCached(EProneStance TargetStance) const;
+
+	/** Record the current conditions as blocking UnProne, backing off further if they were already blocking */
+	void CacheUnProneBlocked(EProneStance TargetStance);
+
+	/** Forget every failed UnProne clearance test */
+	void InvalidateUnProneBlockedCache();
+
+public:
+	/**
+	 * Side-effect free clearance test, unlike Prone() and UnProne() this never changes the capsule or moves the character.
+	 * Stand matches the first encroachment test UnProne() performs, it does not try the adjusted locations UnProne()
+	 * falls back to.
+	 * @return True if the capsule for the query fits at the character's current location
+	 */
+	UFUNCTION(BlueprintCallable, Category="Character Movement")
+	bool TestClearance(EProneClearanceQuery Query) const;
+
+	/**
+	 * Queue an asynchronous clearance test. All requests made during a frame are issued together by
+	 * UProneClearanceSubsystem, duplicates are discarded. The result is usually available on the next frame.
+	 * @see GetCachedClearance
+	 */
+	UFUNCTION(BlueprintCallable, Category="Character Movement")
+	void RequestClearance(EProneClearanceQuery Query);
+
+	/**
+	 * Read the result of the last asynchronous clearance test, this is free and intended for AI and UI.
+	 * Only the machine that requested the test has the result, so predicted stance changes never use it.
+	 * @param MaxFrameAge	Results issued more than this many frames ago are discarded
+	 * @return True if a result for the current capsule size is available
+	 */
+	UFUNCTION(BlueprintPure, Category="Character Movement")
+	bool GetCachedClearance(EProneClearanceQuery Query, bool& bIsClear, int32 MaxFrameAge = 1) const;
+
+	/** Location, shape and collision parameters used to test clearance for Query at the current location */
+	virtual bool GetClearanceQuery(EProneClearanceQuery Query, FVector& OutLocation, FCollisionShape& OutShape,
+		FCollisionQueryParams& OutParams, FCollisionResponseParams& OutResponseParam) const;
+
+	/** Store the result of a clearance test, called by UProneClearanceSubsystem when an asynchronous test completes */
+	void SetCachedClearance(EProneClearanceQuery Query, const FVector& Location, const FCollisionShape& Shape,
+		uint64 FrameStamp, bool bIsClear);
+
 public:
 	virtual bool IsProned() const;
 
@@ -131,18 +312,48 @@ public:
 	 */
 	virtual void UnProne(bool bClientSimulation = false);
 
+	/**
+	 * UnProne directly into TargetStance (Stand or Crouch), testing clearance for and resizing to that stance's capsule
+	 * once, instead of standing up and then crouching.
+	 * @param	bClientSimulation	true when called when bIsProned is replicated to non owned clients, always stands.
+	 */
+	virtual void UnProneToStance(EProneStance TargetStance, bool bClientSimulation = false);
+
 	/** Returns true if the character is allowed to Prone in the current state. By default it is allowed when walking or falling. */
 	virtual bool CanProneInCurrentState() const;
 
+	/** Replicates the crouch change to simulated proxies through ReplicatedStanceState */
+	virtual void Crouch(bool bClientSimulation = false) override;
+	virtual void UnCrouch(bool bClientSimulation = false) override;
+
+protected:
+	/**
+	 * After a prone transition resizes the capsule, CurrentFloor is still valid if the base of the capsule only moved
+	 * vertically, the capsule did not get wider, and the floor contact is still under it. In that case the floor distance
+	 * is updated for the new base and radius, and the next floor sweep is skipped if it stays within the walking range.
+	 * @return True if CurrentFloor was kept
+	 */
+	virtual bool KeepFloorAfterResize(const FVector& OldBaseLocation, float OldScaledRadius);
+
+	/** Called by Prone() once it succeeds, leaves crouch without resizing to the standing capsule in between */
+	void EndCrouchForProne();
+
+public:
 	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
 	virtual void UpdateCharacterStateAfterMovement(float DeltaSeconds) override;
 
 protected:
+	virtual void MoveAutonomous(float ClientTimeStamp, float DeltaTime, uint8 CompressedFlags, const FVector& NewAccel) override;
 	virtual bool ClientUpdatePositionAfterServerUpdate() override;
+	virtual void ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment) override;
 
 	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
 	
 public:
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel,
+		const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+
 	/** Get prediction data for a client game. Should not be used if not running as a client. Allocates the data on demand and can be overridden to allocate a custom override if desired. Result must be a FNetworkPredictionData_Client_Character. */
 	virtual class FNetworkPredictionData_Client* GetPredictionData_Client() const override;
 };
@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "System/PredictedMovementJournal.h"
+#include "System/PredictedMovementSnapshot.h"
+#include "System/PredictedMovementSubsystem.h"
 #include "SprintMovement.generated.h"
 
 class ASprintCharacter;
@@ -17,6 +20,10 @@ private:
 	UPROPERTY(Transient, DuplicateTransient)
 	TObjectPtr<ASprintCharacter> SprintCharacterOwner;
 
+protected:
+	/** Mirrors state changes to UPredictedMovementSubsystem */
+	FPredictedMovementRegistration StateRegistration;
+
 public:
 	/** If true, sprinting acceleration will only be applied when IsSprintingAtSpeed() returns true */
 	UPROPERTY(Category="Character Movement (General Settings)", EditAnywhere, BlueprintReadWrite)
@@ -78,6 +85,24 @@ public:
 	virtual bool HasValidData() const override;
 	virtual void PostLoad() override;
 	virtual void SetUpdatedComponent(USceneComponent* NewUpdatedComponent) override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/** Predicted state published at the end of the last movement tick, safe to call from animation worker threads */
+	UFUNCTION(BlueprintPure, Category="Character Movement", meta=(BlueprintThreadSafe))
+	FPredictedMovementSnapshot GetStateSnapshot() const { return StateSnapshot.Read(); }
+
+protected:
+	/** Fill in the snapshot published after each movement tick */
+	virtual void FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const;
+
+	FPredictedMovementSnapshotBuffer StateSnapshot;
+
+	virtual void PerformMovement(float DeltaTime) override;
+
+	/** Records state after each move while p.PredictedMovement.Journal is enabled */
+	FPredictedMovementJournal Journal;
 
 public:
 	virtual bool IsSprintingAtSpeed() const;
@@ -120,6 +145,14 @@ public:
 	 */
 	virtual bool IsSprintWithinAllowableInputAngle() const;
 
+	/**
+	 * Stateless forms of IsSprintingAtSpeed() and IsSprintWithinAllowableInputAngle(), for applying the same rules
+	 * to agents that have no movement component, such as Mass crowds.
+	 * @param	WalkSpeed	MaxWalkSpeed, or MaxWalkSpeedCrouched when crouching
+	 */
+	static bool IsVelocityAtSprintSpeed(const FVector& InVelocity, bool bMovingOnGround, float WalkSpeed, float VelocityCheckMitigator);
+	static bool IsInputWithinSprintAngle(const FVector& InAcceleration, const FVector& Forward);
+
 	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
 	virtual void UpdateCharacterStateAfterMovement(float DeltaSeconds) override;
 
@@ -129,6 +162,10 @@ protected:
 	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
 	
 public:
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel,
+		const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+
 	/** Get prediction data for a client game. Should not be used if not running as a client. Allocates the data on demand and can be overridden to allocate a custom override if desired. Result must be a FNetworkPredictionData_Client_Character. */
 	virtual class FNetworkPredictionData_Client* GetPredictionData_Client() const override;
 };
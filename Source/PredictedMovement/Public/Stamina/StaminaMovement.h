@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "System/PredictedMovementJournal.h"
+#include "System/PredictedMovementSnapshot.h"
+#include "System/PredictedMovementSubsystem.h"
 #include "System/PredictedMovementVersioning.h"
 #include "StaminaMovement.generated.h"
 
@@ -14,6 +17,10 @@ struct PREDICTEDMOVEMENT_API FStaminaMoveResponseDataContainer : FCharacterMoveR
 	virtual void ServerFillResponseData(const UCharacterMovementComponent& CharacterMovement, const FClientAdjustment& PendingAdjustment) override;
 	virtual bool Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap) override;
 
+	/**
+	 * Only sent with corrections, as a full float. MaxStamina is not predicted and may differ between client and server,
+	 * so the value is not quantized against it. 33 bits per correction including the drained flag.
+	 */
 	float Stamina;
 	bool bStaminaDrained;
 };
@@ -92,6 +99,25 @@ public:
 public:
 	UStaminaMovement(const FObjectInitializer& ObjectInitializer);
 
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/** Predicted state published at the end of the last movement tick, safe to call from animation worker threads */
+	UFUNCTION(BlueprintPure, Category="Character Movement", meta=(BlueprintThreadSafe))
+	FPredictedMovementSnapshot GetStateSnapshot() const { return StateSnapshot.Read(); }
+
+protected:
+	/** Fill in the snapshot published after each movement tick */
+	virtual void FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const;
+
+	FPredictedMovementSnapshotBuffer StateSnapshot;
+
+	virtual void PerformMovement(float DeltaTime) override;
+
+	/** Records state after each move while p.PredictedMovement.Journal is enabled */
+	FPredictedMovementJournal Journal;
+
 protected:
 	/** THIS SHOULD ONLY BE MODIFIED IN DERIVED CLASSES FROM OnStaminaChanged AND NOWHERE ELSE */
 	UPROPERTY()
@@ -115,6 +141,13 @@ public:
 
 	void SetStaminaDrained(bool bNewValue);
 
+	/**
+	 * The default drain rule used by OnStaminaChanged, in a stateless form for applying it to agents that have no
+	 * movement component, such as Mass crowds. Snaps InOutStamina to 0 or InMaxStamina when nearly there.
+	 * @return The new drained state
+	 */
+	static bool ResolveStaminaDrained(float& InOutStamina, float InMaxStamina, bool bInStaminaDrained);
+
 protected:
 	/*
 	 * Drain state entry and exit is handled here. Drain state is used to prevent rapid re-entry of sprinting or other
@@ -131,6 +164,10 @@ private:
 	FStaminaMoveResponseDataContainer StaminaMoveResponseDataContainer;
 
 	FStaminaNetworkMoveDataContainer StaminaMoveDataContainer;
+
+protected:
+	/** Mirrors stamina and drain state to UPredictedMovementSubsystem */
+	FPredictedMovementRegistration StateRegistration;
 	
 public:
 	virtual void OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp,
@@ -142,6 +179,8 @@ public:
 	) override;
 #endif
 	
+	virtual bool ClientUpdatePositionAfterServerUpdate() override;
+
 	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel,
 		const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
 		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
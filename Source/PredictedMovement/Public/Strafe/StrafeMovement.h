@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "System/PredictedMovementJournal.h"
+#include "System/PredictedMovementSnapshot.h"
+#include "System/PredictedMovementSubsystem.h"
 #include "StrafeMovement.generated.h"
 
 class AStrafeCharacter;
@@ -29,6 +32,10 @@ private:
 	UPROPERTY(Transient, DuplicateTransient)
 	TObjectPtr<AStrafeCharacter> StrafeCharacterOwner;
 
+protected:
+	/** Mirrors state changes to UPredictedMovementSubsystem */
+	FPredictedMovementRegistration StateRegistration;
+
 public:
 	/** Max Acceleration (rate of change of velocity) */
 	UPROPERTY(Category="Character Movement (General Settings)", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0"))
@@ -77,6 +84,24 @@ public:
 	virtual bool HasValidData() const override;
 	virtual void PostLoad() override;
 	virtual void SetUpdatedComponent(USceneComponent* NewUpdatedComponent) override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/** Predicted state published at the end of the last movement tick, safe to call from animation worker threads */
+	UFUNCTION(BlueprintPure, Category="Character Movement", meta=(BlueprintThreadSafe))
+	FPredictedMovementSnapshot GetStateSnapshot() const { return StateSnapshot.Read(); }
+
+protected:
+	/** Fill in the snapshot published after each movement tick */
+	virtual void FillStateSnapshot(FPredictedMovementSnapshot& Snapshot) const;
+
+	FPredictedMovementSnapshotBuffer StateSnapshot;
+
+	virtual void PerformMovement(float DeltaTime) override;
+
+	/** Records state after each move while p.PredictedMovement.Journal is enabled */
+	FPredictedMovementJournal Journal;
 
 public:
 	virtual float GetMaxAcceleration() const override;
@@ -114,6 +139,10 @@ protected:
 	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
 	
 public:
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel,
+		const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+
 	/** Get prediction data for a client game. Should not be used if not running as a client. Allocates the data on demand and can be overridden to allocate a custom override if desired. Result must be a FNetworkPredictionData_Client_Character. */
 	virtual class FNetworkPredictionData_Client* GetPredictionData_Client() const override;
 };
@@ -0,0 +1,56 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UCharacterMovementComponent;
+
+/**
+ * Define as 0 to compile out bandwidth accounting for the data each shell adds to ServerMove and
+ * ClientAdjustPosition. It is compiled out of shipping builds by default.
+ */
+#ifndef PREDICTED_MOVEMENT_BANDWIDTH_STATS
+#define PREDICTED_MOVEMENT_BANDWIDTH_STATS !UE_BUILD_SHIPPING
+#endif
+
+/** Data that a shell adds to move traffic, each is accounted separately */
+enum class EPredictedMovementNetChannel : uint8
+{
+	StaminaMove,			// Client ➜ Server, FStaminaNetworkMoveData
+	StaminaCorrection,		// Server ➜ Client, FStaminaMoveResponseDataContainer
+	MAX,
+};
+
+#if PREDICTED_MOVEMENT_BANDWIDTH_STATS
+
+namespace PredictedMovementBandwidth
+{
+	/**
+	 * Counts the bits serialized between construction and destruction, and adds them to "stat PredictedMovement",
+	 * the PredictedMovementBandwidth CSV category and the owning connection's totals (p.PredictedMovement.Bandwidth).
+	 * Only measures the FNetBitWriter / FNetBitReader that the character movement component serializes moves with,
+	 * any other archive is ignored.
+	 */
+	struct PREDICTEDMOVEMENT_API FScope
+	{
+		FScope(const UCharacterMovementComponent& InMovement, FArchive& InAr, EPredictedMovementNetChannel InChannel);
+		~FScope();
+
+	private:
+		const UCharacterMovementComponent& Movement;
+		FArchive& Ar;
+		EPredictedMovementNetChannel Channel;
+		bool bMeasure;
+		int64 StartBits;
+	};
+}
+
+#define PREDICTED_MOVEMENT_BANDWIDTH_SCOPE(Movement, Ar, Channel) \
+	const PredictedMovementBandwidth::FScope ANONYMOUS_VARIABLE(BandwidthScope)(Movement, Ar, Channel)
+
+#else
+
+#define PREDICTED_MOVEMENT_BANDWIDTH_SCOPE(Movement, Ar, Channel)
+
+#endif
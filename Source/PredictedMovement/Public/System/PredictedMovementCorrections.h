@@ -0,0 +1,75 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UCharacterMovementComponent;
+class UPrimitiveComponent;
+
+/**
+ * Define as 0 to compile out correction telemetry. It is compiled out of shipping builds by default.
+ */
+#ifndef PREDICTED_MOVEMENT_CORRECTION_STATS
+#define PREDICTED_MOVEMENT_CORRECTION_STATS !UE_BUILD_SHIPPING
+#endif
+
+/** Which check in ServerCheckClientError() flagged a client error */
+enum class EPredictedMovementCorrectionCause : uint8
+{
+	Position,		// UCharacterMovementComponent::ServerCheckClientError(), the client location is too far off
+	MovementMode,	// UCharacterMovementComponent::ServerCheckClientError(), the client movement mode differs
+	Base,			// UCharacterMovementComponent::ServerCheckClientError(), the client is on a different movement base
+	Stamina,		// Client stamina differs by more than NetworkStaminaCorrectionThreshold
+	MAX,
+};
+
+#if PREDICTED_MOVEMENT_CORRECTION_STATS
+
+namespace PredictedMovementCorrections
+{
+	/**
+	 * Record a client error flagged by the server, with its magnitude (cm for position, units of stamina) and the
+	 * connection's round trip time. Exported to the PredictedMovementCorrections CSV category, and to histograms
+	 * logged by p.PredictedMovement.Corrections.
+	 */
+	PREDICTEDMOVEMENT_API void RecordCorrection(const UCharacterMovementComponent& Movement,
+		EPredictedMovementCorrectionCause Cause, float Error);
+
+	/**
+	 * Record a client error flagged by UCharacterMovementComponent::ServerCheckClientError(), with the same arguments.
+	 * The cause is a movement mode or base mismatch if there is one, and a position error otherwise. The error is
+	 * measured in the space of the client's base when it is a moving base, the same way the engine compares them.
+	 */
+	PREDICTEDMOVEMENT_API void RecordClientError(const UCharacterMovementComponent& Movement,
+		const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		const UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode);
+
+	/** Records how many saved moves ClientUpdatePositionAfterServerUpdate() replays, and how long it takes */
+	struct PREDICTEDMOVEMENT_API FReplayScope
+	{
+		FReplayScope(const UCharacterMovementComponent& Movement);
+		~FReplayScope();
+
+	private:
+		int32 NumMoves;
+		double StartTime;
+	};
+}
+
+#define PREDICTED_MOVEMENT_RECORD_CORRECTION(Movement, Cause, Error) \
+	PredictedMovementCorrections::RecordCorrection(Movement, Cause, Error)
+
+#define PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(Movement, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode) \
+	PredictedMovementCorrections::RecordClientError(Movement, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode)
+
+#define PREDICTED_MOVEMENT_REPLAY_SCOPE(Movement) \
+	const PredictedMovementCorrections::FReplayScope ANONYMOUS_VARIABLE(ReplayScope)(Movement)
+
+#else
+
+#define PREDICTED_MOVEMENT_RECORD_CORRECTION(Movement, Cause, Error)
+#define PREDICTED_MOVEMENT_RECORD_CLIENT_ERROR(Movement, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode)
+#define PREDICTED_MOVEMENT_REPLAY_SCOPE(Movement)
+
+#endif
@@ -0,0 +1,25 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+
+/**
+ * Define as 1 to always skip cosmetic work in server builds (UE_SERVER), without checking
+ * p.PredictedMovement.StripServerCosmetics.
+ */
+#ifndef PREDICTED_MOVEMENT_STRIP_SERVER_COSMETICS
+#define PREDICTED_MOVEMENT_STRIP_SERVER_COSMETICS 0
+#endif
+
+namespace PredictedMovement
+{
+	/**
+	 * @return True if purely cosmetic work for a state transition (mesh offsets and the K2_OnStart / K2_OnEnd events)
+	 * should be skipped for Actor, because it is running on a dedicated server.
+	 * Don't enable this if Blueprint transition events drive gameplay, or if the server traces against the mesh.
+	 */
+	PREDICTEDMOVEMENT_API bool ShouldSkipCosmetics(const AActor* Actor);
+}
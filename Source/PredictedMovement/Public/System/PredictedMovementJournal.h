@@ -0,0 +1,64 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "System/PredictedMovementSnapshot.h"
+
+class UCharacterMovementComponent;
+
+/** Predicted state at the end of a single move */
+struct FPredictedMovementJournalEntry
+{
+	/** Number of times the client timestamp was reset before this move, see MinTimeBetweenTimeStampResets */
+	int32 ResetCount = 0;
+
+	/** Client timestamp of the move, which is the same on the client and the server */
+	float Timestamp = 0.f;
+
+	float MaxSpeed = 0.f;
+	float MaxAcceleration = 0.f;
+	FPredictedMovementSnapshot State;
+};
+
+/**
+ * Records the predicted state after every move, on the autonomous proxy and on the server, so the two can be compared
+ * after a correction. Enabled with p.PredictedMovement.Journal.
+ *
+ * Moves are keyed by the client timestamp and the number of timestamp resets before it, so a client file and a server
+ * file for the same character line up across resets.
+ * Replayed moves are not recorded, the client records each move once when it is first performed.
+ * Recording only copies the entry into a fixed-size buffer; full buffers are formatted and appended to
+ * Saved/PredictedMovement/<Character>_<NetGUID>_<NetMode>.csv by a background task. The NetGUID is the same on the
+ * client and the server, characters that are not replicated use their name instead.
+ *
+ * p.PredictedMovement.JournalDiff <ClientFile> <ServerFile> logs the first field that differs for each correction, the
+ * moves after it usually differ only because of it. p.PredictedMovement.JournalDiffVerbose logs every field instead.
+ */
+class PREDICTEDMOVEMENT_API FPredictedMovementJournal
+{
+public:
+	static bool IsEnabled();
+
+	/** Record State for the move Movement just performed */
+	void Record(const UCharacterMovementComponent* Movement, const FPredictedMovementSnapshot& State);
+
+	/** Write any recorded entries in the background */
+	void Flush();
+
+	/**
+	 * Compare the moves present in both journal files
+	 * A correction starts at the first move that differs and lasts until a move matches again
+	 * @param	OutDifferences	A description of the first field that differs for each correction
+	 * @param	bAllFields		If true, describe every field that differs for every move instead
+	 * @return False if either file could not be loaded
+	 */
+	static bool Diff(const FString& ClientFile, const FString& ServerFile, TArray<FString>& OutDifferences, bool bAllFields = false);
+
+private:
+	TArray<FPredictedMovementJournalEntry> Entries;
+	FString FilePath;
+
+	float LastTimestamp = 0.f;
+	int32 ResetCount = 0;
+};
@@ -0,0 +1,99 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include <cmath>
+
+/**
+ * Rules shared by the movement components, as plain arithmetic with no engine dependencies.
+ * The UE classes call into these, so tools and tests outside the engine can include this header on its own and
+ * get identical results.
+ */
+namespace PredictedMovementKernel
+{
+	/** Same tolerance as FMath::IsNearlyZero and FMath::IsNearlyEqual */
+	inline constexpr float SmallNumber = 1.e-8f;
+
+	/** Sprinting is only allowed within this angle of the facing direction */
+	inline constexpr float MaxSprintInputDegrees = 50.f;
+	inline constexpr float MaxSprintInputNormal = 0.64278732f;  // cos(rad(MaxSprintInputDegrees))
+
+	inline bool IsNearlyZero(float Value)
+	{
+		return std::abs(Value) <= SmallNumber;
+	}
+
+	inline bool IsNearlyEqual(float A, float B)
+	{
+		return std::abs(A - B) <= SmallNumber;
+	}
+
+	inline float Clamp(float Value, float Min, float Max)
+	{
+		return Value < Min ? Min : (Value < Max ? Value : Max);
+	}
+
+	/**
+	 * @param	SpeedSquared	Squared speed, in 3D on ground (to account for slopes) or 2D when falling
+	 * @param	WalkSpeed		MaxWalkSpeed, or MaxWalkSpeedCrouched when crouching
+	 */
+	inline bool IsSprintingAtSpeed(float SpeedSquared, float WalkSpeed, float VelocityCheckMitigator)
+	{
+		// When struggling to surpass walk speed, which can occur with heavy rotation and low acceleration, we
+		// mitigate the check so there isn't a constant re-entry that can occur as an edge case
+		return SpeedSquared >= (WalkSpeed * WalkSpeed * VelocityCheckMitigator);
+	}
+
+	/** @param	InputDot	Dot product of the normalized 2D input acceleration and the facing direction */
+	inline bool IsSprintWithinAllowableInputAngle(float InputDot)
+	{
+		// This check ensures that we are not sprinting backward or sideways, while allowing leeway 
+		// This angle allows sprinting when holding forward, forward left, forward right
+		// but not left or right or backward)
+		if constexpr (MaxSprintInputDegrees > 0.f)
+		{
+			return InputDot >= MaxSprintInputNormal;
+		}
+		else
+		{
+			return true;
+		}
+	}
+
+	inline float GetRemainingLockCooldown(float LockDuration, float CurrentTimestamp, float LockTimestamp)
+	{
+		return Clamp(LockDuration - (CurrentTimestamp - LockTimestamp), 0.f, LockDuration);
+	}
+
+	inline float ClampStamina(float Stamina, float MaxStamina)
+	{
+		return Clamp(Stamina, 0.f, MaxStamina);
+	}
+
+	/**
+	 * Default drain rule. Snaps InOutStamina to 0 or MaxStamina when nearly there.
+	 * @return The new drained state
+	 */
+	inline bool ResolveStaminaDrained(float& InOutStamina, float MaxStamina, bool bStaminaDrained)
+	{
+		if (IsNearlyZero(InOutStamina))
+		{
+			InOutStamina = 0.f;
+			return true;
+		}
+		// This will need to change if not using MaxStamina for recovery, here is an example (commented out) that uses
+		// 10% instead; to use this, comment out the existing else if statement, and change the 0.1f to the percentage
+		// you want to use (0.1f is 10%)
+		//
+		// else if (bStaminaDrained && InOutStamina >= MaxStamina * 0.1f)
+		// {
+		// 	return false;
+		// }
+		else if (IsNearlyEqual(InOutStamina, MaxStamina))
+		{
+			InOutStamina = MaxStamina;
+			return false;
+		}
+		return bStaminaDrained;
+	}
+}
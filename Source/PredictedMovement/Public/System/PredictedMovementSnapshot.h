@@ -0,0 +1,70 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "PredictedMovementSnapshot.generated.h"
+
+/**
+ * Predicted state of a character at the end of its last movement tick.
+ * Each movement component fills in the fields it owns, the rest keep their defaults.
+ */
+USTRUCT(BlueprintType)
+struct PREDICTEDMOVEMENT_API FPredictedMovementSnapshot
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsCrouched = false;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsSprinting = false;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsProned = false;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsProneLocked = false;
+
+	/** Time the prone lock was last applied, -1 if it never was */
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	float ProneLockTimestamp = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsStrafing = false;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	bool bIsStaminaDrained = false;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	float Stamina = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category=Character)
+	float MaxStamina = 0.f;
+};
+
+/**
+ * Two copies of FPredictedMovementSnapshot, written by the game thread once per movement tick and read from any
+ * thread without locks. Readers always get the last complete snapshot.
+ * A read must not span two publishes, which holds for animation worker threads because the mesh ticks after the
+ * movement component and its parallel update completes within the frame.
+ */
+struct FPredictedMovementSnapshotBuffer
+{
+	void Publish(const FPredictedMovementSnapshot& Snapshot)
+	{
+		const int32 WriteIndex = ReadIndex.load(std::memory_order_relaxed) ^ 1;
+		Buffers[WriteIndex] = Snapshot;
+		ReadIndex.store(WriteIndex, std::memory_order_release);
+	}
+
+	FPredictedMovementSnapshot Read() const
+	{
+		return Buffers[ReadIndex.load(std::memory_order_acquire)];
+	}
+
+private:
+	FPredictedMovementSnapshot Buffers[2];
+	std::atomic<int32> ReadIndex { 0 };
+};
@@ -0,0 +1,9 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+/** Cost of the predicted movement shells, view with "stat PredictedMovement" */
+DECLARE_STATS_GROUP(TEXT("PredictedMovement"), STATGROUP_PredictedMovement, STATCAT_Advanced);
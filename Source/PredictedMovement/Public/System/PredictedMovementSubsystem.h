@@ -0,0 +1,127 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+#include "PredictedMovementSubsystem.generated.h"
+
+class ACharacter;
+class UCharacterMovementComponent;
+class UPredictedMovementSubsystem;
+
+/** Predicted states mirrored by UPredictedMovementSubsystem */
+UENUM(BlueprintType)
+enum class EPredictedMovementState : uint8
+{
+	Sprinting,
+	Proned,
+	Strafing,
+	StaminaDrained,
+	MAX			UMETA(Hidden)
+};
+
+/**
+ * Registration of a character with UPredictedMovementSubsystem, owned by its movement component.
+ * Does nothing while unregistered, so the movement components can report transitions unconditionally.
+ */
+struct PREDICTEDMOVEMENT_API FPredictedMovementRegistration
+{
+	void Register(const UCharacterMovementComponent* Movement);
+	void Unregister();
+
+	void SetState(EPredictedMovementState State, bool bEnabled) const;
+	void SetStamina(float NewStamina) const;
+
+private:
+	TWeakObjectPtr<UPredictedMovementSubsystem> Subsystem;
+	int32 Slot = INDEX_NONE;
+};
+
+/**
+ * Mirrors the predicted state of every registered character in contiguous arrays, written only when a state changes.
+ * Each state also keeps a list of the characters currently in it, so queries such as "sprinting characters within
+ * 20m" only visit characters in that state instead of iterating and casting every actor.
+ *
+ * Positions change every frame and are not mirrored, the spatial queries read them from the characters that are in
+ * the requested state.
+ */
+UCLASS()
+class PREDICTEDMOVEMENT_API UPredictedMovementSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+public:
+	/** @return Slot to pass to the other functions, valid until Unregister */
+	int32 Register(ACharacter* Character);
+	void Unregister(int32 Slot);
+
+	void SetState(int32 Slot, EPredictedMovementState State, bool bEnabled);
+	void SetStamina(int32 Slot, float NewStamina);
+
+public:
+	/** @return Number of registered characters currently in State */
+	UFUNCTION(BlueprintPure, Category="Predicted Movement")
+	int32 GetNumInState(EPredictedMovementState State) const;
+
+	/** Append every registered character currently in State */
+	UFUNCTION(BlueprintCallable, Category="Predicted Movement")
+	void GetCharactersInState(EPredictedMovementState State, TArray<ACharacter*>& OutCharacters) const;
+
+	/** Append registered characters currently in State whose location is within Radius of Origin */
+	UFUNCTION(BlueprintCallable, Category="Predicted Movement")
+	void GetCharactersInStateInRadius(EPredictedMovementState State, const FVector& Origin, float Radius,
+		TArray<ACharacter*>& OutCharacters) const;
+
+	/** Append registered characters currently in State whose location is inside Box */
+	UFUNCTION(BlueprintCallable, Category="Predicted Movement")
+	void GetCharactersInStateInBox(EPredictedMovementState State, const FBox& Box, TArray<ACharacter*>& OutCharacters) const;
+
+	/** @return True if Character is registered, with its mirrored stamina */
+	UFUNCTION(BlueprintCallable, Category="Predicted Movement")
+	bool GetStamina(const ACharacter* Character, float& OutStamina) const;
+
+public:
+	/** @return True if another deferred proxy cosmetic transition can be applied in this world this frame */
+	bool ConsumeProxyCosmeticsBudget(int32 PerFrame);
+
+protected:
+	/** Visit each character in State, stops early if Visitor returns false */
+	template<typename TVisitor>
+	void ForEachInState(EPredictedMovementState State, TVisitor&& Visitor) const
+	{
+		for (const int32 Slot : StateMembers[static_cast<uint8>(State)])
+		{
+			if (ACharacter* Character = Characters[Slot].Get())
+			{
+				if (!Visitor(Character))
+				{
+					return;
+				}
+			}
+		}
+	}
+
+private:
+	/** Per slot, free slots have a null character */
+	TArray<TWeakObjectPtr<ACharacter>> Characters;
+	TArray<uint8> StateBits;
+	TArray<float> Stamina;
+
+	/** Slots of the characters in each state */
+	TArray<int32> StateMembers[static_cast<uint8>(EPredictedMovementState::MAX)];
+
+	TArray<int32> FreeSlots;
+
+	TMap<TObjectKey<ACharacter>, int32> SlotsByCharacter;
+
+	uint64 ProxyCosmeticsBudgetFrame = 0;
+	int32 ProxyCosmeticsBudgetUsed = 0;
+};
@@ -0,0 +1,42 @@
+﻿// Copyright (c) 2023 Jared Taylor. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+
+class ACharacter;
+enum class EPredictedMovementState : uint8;
+
+/**
+ * Define as 0 to compile out the PredictedMovement trace channel. It is compiled out of shipping builds by default.
+ */
+#ifndef PREDICTED_MOVEMENT_TRACE_ENABLED
+#define PREDICTED_MOVEMENT_TRACE_ENABLED (UE_TRACE_ENABLED && CPUPROFILERTRACE_ENABLED && !UE_BUILD_SHIPPING)
+#endif
+
+#if PREDICTED_MOVEMENT_TRACE_ENABLED
+
+/**
+ * CPU scopes for the shells' state updates, transitions and stance physics queries, and a StateChange event for
+ * every predicted state change. Record with -trace=cpu,PredictedMovement or "Trace.Enable PredictedMovement".
+ */
+UE_TRACE_CHANNEL_EXTERN(PredictedMovementChannel, PREDICTEDMOVEMENT_API);
+
+namespace PredictedMovementTrace
+{
+	/** Emit a StateChange event for Character, stamped with the CPU cycle counter and its local role */
+	PREDICTEDMOVEMENT_API void TraceStateChange(const ACharacter* Character, EPredictedMovementState State, bool bEnabled);
+}
+
+#define PREDICTED_MOVEMENT_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Name, PredictedMovementChannel)
+#define PREDICTED_MOVEMENT_TRACE_STATE_CHANGE(Character, State, bEnabled) \
+	PredictedMovementTrace::TraceStateChange(Character, State, bEnabled)
+
+#else
+
+#define PREDICTED_MOVEMENT_TRACE_SCOPE(Name)
+#define PREDICTED_MOVEMENT_TRACE_STATE_CHANGE(Character, State, bEnabled)
+
+#endif